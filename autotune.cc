@@ -0,0 +1,320 @@
+/*
+# autotune.cc
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <cstdio>
+#include <sstream>
+#include <vector>
+
+#include <CL/cl.hpp>
+
+#include "autotune.h"
+
+// Candidate variants. Local sizes are every power of two from 32 up to the
+// variant's CL_KERNEL_WORK_GROUP_SIZE, plus the driver's own choice.
+
+static const uint32_t tune_vecs[] = {1, 4, 8, 16};
+static const uint32_t tune_elems[] = {1, 2, 4, 8};
+
+static const uint32_t tune_warmup = 1;
+static const uint32_t tune_runs = 3;
+
+//*********************************************************************
+//
+// Autotuner Constructors/Destructors
+//
+//*********************************************************************
+//
+// Constructor(s)
+//
+Autotuner::Autotuner(OclEnv * env) : env(env) {}
+
+//
+// Destructor
+//
+Autotuner::~Autotuner(){}
+
+//
+// Kernels of other element types than float are tuned separately, e.g.
+// Summer<double>
+//
+std::string Autotuner::TuningKey(uint32_t device)
+{
+  std::string entry = this->env->GetKernelOp()->entry;
+  uint32_t type = this->env->GetKernelType();
+
+  if (TYPE_FLOAT != type)
+    entry += std::string("<") + GetElementInfo(type).cl_type + ">";
+
+  return this->env->GetDevice(device)->getInfo<CL_DEVICE_NAME>() + '\t' +
+    entry;
+}
+
+//
+// Empty if there is no cache directory, i.e. nothing is persisted
+//
+std::string Autotuner::TuningFile()
+{
+  std::string dir = this->env->GetCacheDir();
+
+  return dir.empty() ? "" : dir + "/tuning.txt";
+}
+
+//*********************************************************************
+//
+// Autotuner Benchmarking
+//
+//*********************************************************************
+
+//
+// Tune()
+//
+// The inputs are made on the device by PhiloxUniform, so tuning costs no host
+// transfers (with wider element types than float only their first half, the
+// values do not matter for the timing). Candidates that fail to launch (e.g.
+// a work-group size the variant can not run with) are skipped.
+//
+KernelConfig Autotuner::Tune(uint32_t device, uint32_t n)
+{
+  cl_int err;
+
+  cl::Context * cntxt = this->env->GetContext(device);
+  cl::CommandQueue * cq = this->env->GetCq(device);
+  cl::Kernel * gen = this->env->GetGenerateKernel(device);
+
+  const KernelSignature * op = this->env->GetKernelOp();
+
+  size_t size = static_cast<size_t>(n) *
+    GetElementInfo(this->env->GetKernelType()).size;
+  uint32_t n_buffers = op->n_inputs + op->n_outputs;
+
+  // inputs first, then outputs, as in the kernel's arguments
+  std::vector<cl::Buffer> buffers;
+
+  for (uint32_t b = 0; b < n_buffers; b++)
+  {
+    buffers.push_back(cl::Buffer((*cntxt), CL_MEM_READ_WRITE, size, NULL,
+      &err));
+    if (CL_SUCCESS != err)
+      this->env->Die(err, "Autotuner buffer");
+  }
+
+  for (uint32_t b = 0; b < op->n_inputs; b++)
+  {
+    gen->setArg(0, buffers.at(b));
+    gen->setArg(1, static_cast<cl_ulong>(0));
+    gen->setArg(2, static_cast<cl_uint>(n));
+    gen->setArg(3, static_cast<cl_uint>(b));
+    gen->setArg(4, static_cast<cl_uint>(1));
+    gen->setArg(5, static_cast<cl_uint>(0));
+
+    err = cq->enqueueNDRangeKernel((*gen), cl::NDRange(0),
+      cl::NDRange((n + 3) / 4), cl::NullRange, NULL, NULL);
+    if (CL_SUCCESS != err)
+      this->env->Die(err, "Autotuner input generation");
+  }
+
+  cq->finish();
+
+  std::vector<KernelConfig> variants;
+
+  for (uint32_t v = 0; v < sizeof(tune_vecs) / sizeof(tune_vecs[0]); v++)
+  {
+    for (uint32_t e = 0; e < sizeof(tune_elems) / sizeof(tune_elems[0]); e++)
+    {
+      KernelConfig kc = {tune_vecs[v], tune_elems[e], false, 0};
+      variants.push_back(kc);
+    }
+
+    KernelConfig kc = {tune_vecs[v], 1, true, 0};
+    variants.push_back(kc);
+  }
+
+  printf("Device %d: autotuning %s (%s), %d elements\n", device,
+    op->entry.c_str(),
+    this->env->GetDevice(device)->getInfo<CL_DEVICE_NAME>().c_str(), n);
+
+  KernelConfig best = {1, 1, false, 0};
+  cl_ulong best_ns = 0;
+
+  for (uint32_t v = 0; v < variants.size(); v++)
+  {
+    KernelConfig kc = variants.at(v);
+
+    this->env->SetKernelConfig(device, kc);
+
+    size_t wg_max = this->env->GetKernelWorkGroupInfo(device);
+
+    KernelConfig variant_best = kc;
+    cl_ulong variant_ns = 0;
+
+    for (size_t local = 0; local <= wg_max; local = local ? local * 2 : 32)
+    {
+      kc.local = local;
+      this->env->SetKernelConfig(device, kc);
+
+      cl_ulong ns = this->TimeVariant(device, n, buffers);
+
+      if (ns != 0 && (variant_ns == 0 || ns < variant_ns))
+      {
+        variant_ns = ns;
+        variant_best = kc;
+      }
+    }
+
+    if (variant_ns == 0)
+    {
+      printf("  VEC=%2d ELEMS=%d%s: could not be launched\n", kc.vec,
+        kc.elems, kc.grid_stride ? " GRID_STRIDE" : "");
+      continue;
+    }
+
+    printf("  VEC=%2d ELEMS=%d%s local=%4d: %.3f (GB/s)\n", kc.vec, kc.elems,
+      kc.grid_stride ? " GRID_STRIDE" : "", variant_best.local,
+      static_cast<double>(n_buffers) * size / variant_ns);
+
+    if (best_ns == 0 || variant_ns < best_ns)
+    {
+      best_ns = variant_ns;
+      best = variant_best;
+    }
+  }
+
+  this->env->SetKernelConfig(device, best);
+
+  printf("Device %d: using %s, local %d\n", device,
+    OclEnv::KernelOptions(best).c_str(), best.local);
+
+  return best;
+}
+
+cl_ulong Autotuner::TimeVariant(uint32_t device, uint32_t n,
+  std::vector<cl::Buffer> & buffers)
+{
+  cl_int err;
+
+  cl::CommandQueue * cq = this->env->GetCq(device);
+  cl::Kernel * kern = this->env->GetKernel(device);
+
+  cl::NDRange global, local;
+  this->env->KernelRange(device, n, &global, &local);
+
+  // the parameter values do not change the timing, the defaults will do
+  const KernelSignature * op = this->env->GetKernelOp();
+  uint32_t arg = 0;
+
+  for (uint32_t b = 0; b < buffers.size(); b++)
+    kern->setArg(arg++, buffers.at(b));
+  kern->setArg(arg++, static_cast<cl_uint>(n));
+  for (uint32_t p = 0; p < op->param_defaults.size(); p++)
+    OclEnv::SetParamArg(kern, arg++, this->env->GetKernelType(),
+      op->param_defaults.at(p));
+
+  cl_ulong best = 0;
+
+  for (uint32_t r = 0; r < tune_warmup + tune_runs; r++)
+  {
+    cl::Event event;
+
+    err = cq->enqueueNDRangeKernel((*kern), cl::NDRange(0), global, local,
+      NULL, &event);
+    if (CL_SUCCESS != err || CL_SUCCESS != event.wait())
+      return 0;
+
+    if (r < tune_warmup)
+      continue;
+
+    cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    cl_ulong end = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+
+    if (end > start && (best == 0 || end - start < best))
+      best = end - start;
+  }
+
+  return best;
+}
+
+//*********************************************************************
+//
+// Autotuner Persistence
+//
+//*********************************************************************
+
+//
+// tuning.txt holds one line per device name and kernel:
+//
+//   <CL_DEVICE_NAME>\t<entry point>\t<vec> <elems> <grid_stride> <local>
+//
+bool Autotuner::Load(uint32_t device)
+{
+  std::string file_name = this->TuningFile();
+
+  if (file_name.empty())
+    return false;
+
+  std::string fields;
+
+  if (!OclEnv::LoadKeyedLine(file_name, this->TuningKey(device), &fields))
+    return false;
+
+  std::istringstream f_stream(fields);
+  KernelConfig kc;
+  uint32_t grid_stride;
+
+  if (!(f_stream >> kc.vec >> kc.elems >> grid_stride >> kc.local) ||
+    (kc.vec != 1 && kc.vec != 2 && kc.vec != 4 && kc.vec != 8 &&
+      kc.vec != 16) || kc.elems == 0)
+    return false;
+
+  kc.grid_stride = grid_stride != 0;
+
+  this->env->SetKernelConfig(device, kc);
+
+  // the tuned work-group size may not fit a rebuilt kernel (new driver)
+  if (kc.local > this->env->GetKernelWorkGroupInfo(device))
+  {
+    kc.local = 0;
+    this->env->SetKernelConfig(device, kc);
+  }
+
+  printf("Device %d: tuned %s %s, local %d\n", device,
+    this->env->GetKernelOp()->entry.c_str(),
+    OclEnv::KernelOptions(kc).c_str(), kc.local);
+
+  return true;
+}
+
+//
+// Replaces (or adds) device's line.
+//
+void Autotuner::Save(uint32_t device, const KernelConfig & kernel_config)
+{
+  std::string file_name = this->TuningFile();
+
+  if (file_name.empty())
+    return;
+
+  std::ostringstream fields;
+  fields << kernel_config.vec << ' ' << kernel_config.elems << ' ' <<
+    (kernel_config.grid_stride ? 1 : 0) << ' ' << kernel_config.local;
+
+  OclEnv::SaveKeyedLine(file_name, this->TuningKey(device), fields.str());
+}
+
+//EOF
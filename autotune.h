@@ -0,0 +1,73 @@
+/*
+# autotune.h
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef  OCLPTX_AUTOTUNE_H_
+#define  OCLPTX_AUTOTUNE_H_
+
+#include <string>
+#include <vector>
+
+#include <CL/cl.hpp>
+
+#include "customtypes.h"
+#include "oclenv.h"
+
+//
+// Picks the fastest variant of a device's element-wise kernel (vector width,
+// vectors per work-item or grid-stride loop, work-group size) by timing each
+// of them on chunk sized buffers, and remembers the winner per device name
+// and kernel in tuning.txt in the kernel cache directory.
+//
+
+class Autotuner{
+
+  public:
+
+    Autotuner(OclEnv * env);
+
+    ~Autotuner();
+
+    // Benchmarks every variant for n element launches and leaves the best one
+    // set on device.
+    KernelConfig Tune(uint32_t device, uint32_t n);
+
+    // Sets the persisted configuration for device's name, if there is one.
+    bool Load(uint32_t device);
+
+    void Save(uint32_t device, const KernelConfig & kernel_config);
+
+    std::string TuningFile();
+
+  private:
+
+    // Best of several profiled launches of the current variant (ns), or 0 if
+    // it can not be launched with this geometry.
+    cl_ulong TimeVariant(uint32_t device, uint32_t n,
+      std::vector<cl::Buffer> & buffers);
+
+    // tuning.txt key: device name and kernel entry point
+    std::string TuningKey(uint32_t device);
+
+    OclEnv * env;
+};
+
+#endif
+
+//EOF
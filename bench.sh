@@ -0,0 +1,92 @@
+#!/bin/bash
+# bench.sh
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+# Sweeps ./program over every combination of the lists below. Each
+# combination is run WARMUP + REPEAT times in one process; the program itself
+# appends the median/p95 wall time and GB/s of the REPEAT measured runs to
+# $OUT.csv, which is converted to $OUT.json at the end.
+#
+# Every list can be overridden from the environment, e.g.
+#   DEPTHS="1 2" TRANSFERS=pinned ./bench.sh
+#   QUEUES="single multi" ./bench.sh    (one queue vs. copy/compute queues)
+# Entries of DEVICESETS are -gpus= lists, "all" uses every device. Any
+# arguments are passed through to every run.
+
+DATASIZES=${DATASIZES:-"1000"}
+CHUNKSIZES=${CHUNKSIZES:-"10 50 100"}
+DEVICESETS=${DEVICESETS:-"all"}
+TRANSFERS=${TRANSFERS:-"copy pinned zerocopy"}
+QUEUES=${QUEUES:-"multi"}
+DEPTHS=${DEPTHS:-"1 2 3 4"}
+WARMUP=${WARMUP:-1}
+REPEAT=${REPEAT:-5}
+OUT=${OUT:-bench_results}
+PROGRAM=${PROGRAM:-./program}
+
+rm -f "$OUT.csv" "$OUT.json" "$OUT.log"
+
+for datasize in $DATASIZES; do
+for chunksize in $CHUNKSIZES; do
+for devices in $DEVICESETS; do
+for transfer in $TRANSFERS; do
+for queues in $QUEUES; do
+for depth in $DEPTHS; do
+  device_arg=""
+  if [ "$devices" != "all" ]; then
+    device_arg="-gpus=$devices"
+  fi
+
+  echo "datasize=$datasize chunksize=$chunksize devices=$devices \
+transfer=$transfer queues=$queues depth=$depth"
+
+  if ! $PROGRAM -datasize=$datasize -chunksize=$chunksize $device_arg \
+    -transfer=$transfer -queues=$queues -depth=$depth -warmup=$WARMUP -repeat=$REPEAT \
+    -results="$OUT.csv" "$@" >> "$OUT.log" 2>&1
+  then
+    echo "  FAILED, see $OUT.log"
+  fi
+done
+done
+done
+done
+done
+done
+
+if [ ! -f "$OUT.csv" ]; then
+  echo "No results."
+  exit 1
+fi
+
+# CSV -> JSON array of objects, numbers unquoted
+awk -F, '
+NR == 1 { for (i = 1; i <= NF; i++) key[i] = $i; print "["; next }
+{
+  printf "%s  {", (NR > 2 ? ",\n" : "")
+  for (i = 1; i <= NF; i++)
+  {
+    numeric = ($i ~ /^-?[0-9.]+$/) && key[i] != "devices"
+    value = numeric ? $i : "\"" $i "\""
+    printf "%s\"%s\": %s", (i > 1 ? ", " : ""), key[i], value
+  }
+  printf "}"
+}
+END { print "\n]" }' "$OUT.csv" > "$OUT.json"
+
+column -s, -t < "$OUT.csv" 2>/dev/null || cat "$OUT.csv"
+echo "Results in $OUT.csv and $OUT.json, program output in $OUT.log"
@@ -0,0 +1,230 @@
+/*
+# bufferpool.cc
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <cstdio>
+#include <algorithm>
+
+#include "bufferpool.h"
+
+//*********************************************************************
+//
+// BufferPool Constructors/Destructors
+//
+//*********************************************************************
+//
+// Constructor(s)
+//
+BufferPool::BufferPool(cl::Context * context, cl::Device * device) :
+  context(context)
+{
+  // CL_DEVICE_MEM_BASE_ADDR_ALIGN is in bits
+  this->align = std::max<uint64_t>(
+    device->getInfo<CL_DEVICE_MEM_BASE_ADDR_ALIGN>() / 8, 1);
+  this->max_alloc = device->getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+
+  this->stats.arena = 0;
+  this->stats.in_use = 0;
+  this->stats.high_water = 0;
+  this->stats.carved = 0;
+  this->stats.reused = 0;
+  this->stats.overflow = 0;
+}
+
+//
+// Destructor
+//
+BufferPool::~BufferPool(){}
+
+//*********************************************************************
+//
+// BufferPool Allocation
+//
+//*********************************************************************
+
+cl_int BufferPool::Reserve(uint64_t bytes, uint32_t n_buffers)
+{
+  std::lock_guard<std::mutex> lock(this->pool_mutex);
+
+  // every sub-buffer starts on an alignment boundary
+  bytes = std::min(this->max_alloc,
+    (bytes / this->align + n_buffers) * this->align);
+
+  if (bytes <= this->stats.arena)
+    return CL_SUCCESS;
+
+  for (uint32_t b = 0; b < this->blocks.size(); b++)
+  {
+    if (this->blocks.at(b).in_use)
+      return CL_SUCCESS;
+  }
+
+  // sub-buffers keep the old arena alive until the last one is gone
+  this->blocks.clear();
+  this->arena = cl::Buffer();
+  this->stats.arena = 0;
+
+  cl_int err;
+  this->arena = cl::Buffer((*this->context), CL_MEM_READ_WRITE, bytes, NULL,
+    &err);
+  if (CL_SUCCESS != err)
+  {
+    this->arena = cl::Buffer();
+    return err;
+  }
+
+  this->stats.arena = bytes;
+
+  return CL_SUCCESS;
+}
+
+cl_int BufferPool::Acquire(size_t size, cl_mem_flags flags,
+  cl::Buffer * buffer)
+{
+  std::lock_guard<std::mutex> lock(this->pool_mutex);
+
+  cl_int err = CL_SUCCESS;
+  uint64_t rounded = (size + this->align - 1) / this->align * this->align;
+
+  for (uint32_t b = 0; b < this->blocks.size(); b++)
+  {
+    Block * block = &this->blocks.at(b);
+
+    if (block->in_use || block->size != rounded || block->flags != flags)
+      continue;
+
+    block->in_use = true;
+    *buffer = block->buffer;
+
+    this->stats.reused++;
+    this->stats.in_use += rounded;
+    this->stats.high_water = std::max(this->stats.high_water,
+      this->stats.in_use);
+
+    return err;
+  }
+
+  uint64_t offset;
+
+  if (!this->Carve(rounded, &offset))
+  {
+    this->DropReleased();
+
+    if (!this->Carve(rounded, &offset))
+    {
+      *buffer = cl::Buffer((*this->context), flags, size, NULL, &err);
+      this->stats.overflow++;
+      return err;
+    }
+  }
+
+  // the sub-buffer spans the whole block: it is reused for any request that
+  // rounds to the same size
+  cl_buffer_region region = {static_cast<size_t>(offset),
+    static_cast<size_t>(rounded)};
+
+  Block block;
+  block.buffer = this->arena.createSubBuffer(flags,
+    CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+  if (CL_SUCCESS != err)
+    return err;
+
+  block.offset = offset;
+  block.size = rounded;
+  block.flags = flags;
+  block.in_use = true;
+
+  uint32_t b = 0;
+  while (b < this->blocks.size() && this->blocks.at(b).offset < offset)
+    b++;
+  this->blocks.insert(this->blocks.begin() + b, block);
+
+  *buffer = block.buffer;
+
+  this->stats.carved++;
+  this->stats.in_use += rounded;
+  this->stats.high_water = std::max(this->stats.high_water,
+    this->stats.in_use);
+
+  return err;
+}
+
+void BufferPool::Release(cl::Buffer * buffer)
+{
+  std::lock_guard<std::mutex> lock(this->pool_mutex);
+
+  for (uint32_t b = 0; b < this->blocks.size(); b++)
+  {
+    Block * block = &this->blocks.at(b);
+
+    if (block->in_use && block->buffer() == (*buffer)())
+    {
+      block->in_use = false;
+      this->stats.in_use -= block->size;
+      break;
+    }
+  }
+
+  // standalone (overflow) buffers are simply freed
+  *buffer = cl::Buffer();
+}
+
+PoolStats BufferPool::Stats()
+{
+  std::lock_guard<std::mutex> lock(this->pool_mutex);
+
+  return this->stats;
+}
+
+bool BufferPool::Carve(uint64_t size, uint64_t * offset)
+{
+  uint64_t start = 0;
+
+  for (uint32_t b = 0; b <= this->blocks.size(); b++)
+  {
+    uint64_t end = (b < this->blocks.size()) ? this->blocks.at(b).offset :
+      this->stats.arena;
+
+    if (end >= start + size)
+    {
+      *offset = start;
+      return true;
+    }
+
+    if (b < this->blocks.size())
+      start = this->blocks.at(b).offset + this->blocks.at(b).size;
+  }
+
+  return false;
+}
+
+void BufferPool::DropReleased()
+{
+  std::vector<Block> kept;
+
+  for (uint32_t b = 0; b < this->blocks.size(); b++)
+  {
+    if (this->blocks.at(b).in_use)
+      kept.push_back(this->blocks.at(b));
+  }
+
+  this->blocks.swap(kept);
+}
+
+//EOF
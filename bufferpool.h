@@ -0,0 +1,101 @@
+/*
+# bufferpool.h
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef  OCLPTX_BUFFERPOOL_H_
+#define  OCLPTX_BUFFERPOOL_H_
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <CL/cl.hpp>
+
+//
+// Device memory for one device, carved out of a single large buffer (the
+// arena, at most CL_DEVICE_MAX_MEM_ALLOC_SIZE) as sub-buffers aligned to
+// CL_DEVICE_MEM_BASE_ADDR_ALIGN. Released sub-buffers are kept and handed out
+// again to the next request of the same size and flags, so repeated jobs do
+// not allocate (or have the driver clear) device memory again. Requests the
+// arena can not hold get standalone buffers.
+//
+
+struct PoolStats
+{
+  uint64_t arena; // bytes of the arena, 0 until reserved
+  uint64_t in_use; // bytes of sub-buffers currently handed out
+  uint64_t high_water; // most bytes handed out at any one time
+  uint32_t carved; // sub-buffers created
+  uint32_t reused; // requests served by a released sub-buffer
+  uint32_t overflow; // standalone buffers, because the arena was full
+};
+
+class BufferPool{
+
+  public:
+
+    BufferPool(cl::Context * context, cl::Device * device);
+
+    ~BufferPool();
+
+    // Grows the arena to hold at least bytes split over n_buffers
+    // sub-buffers, if none is in use.
+    cl_int Reserve(uint64_t bytes, uint32_t n_buffers);
+
+    cl_int Acquire(size_t size, cl_mem_flags flags, cl::Buffer * buffer);
+
+    // Returns buffer (from Acquire) to the pool and empties *buffer.
+    void Release(cl::Buffer * buffer);
+
+    PoolStats Stats();
+
+  private:
+
+    struct Block
+    {
+      cl::Buffer buffer;
+      uint64_t offset; // into the arena, bytes
+      uint64_t size; // rounded up to the alignment
+      cl_mem_flags flags;
+      bool in_use;
+    };
+
+    // first fit offset for size bytes, false if there is no such gap
+    bool Carve(uint64_t size, uint64_t * offset);
+
+    // forgets the released sub-buffers, making their space available
+    void DropReleased();
+
+    cl::Context * context;
+
+    cl::Buffer arena;
+
+    uint64_t align; // bytes
+    uint64_t max_alloc; // bytes
+
+    std::vector<Block> blocks; // by offset
+
+    PoolStats stats;
+
+    std::mutex pool_mutex;
+};
+
+#endif
+
+//EOF
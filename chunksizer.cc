@@ -0,0 +1,366 @@
+/*
+# chunksizer.cc
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <vector>
+
+#include <CL/cl.hpp>
+
+#include "chunksizer.h"
+
+// Probe: transfers of up to probe_bytes, best of probe_runs after a warmup.
+
+static const uint64_t probe_bytes = 32 << 20;
+static const uint32_t probe_runs = 3;
+
+// Sizing: per chunk command latencies should cost at most about 5% of its
+// transfer time, chunks are a power of two of at least min_chunk bytes (page
+// aligned, for zero copy) and at most a quarter of the device memory is used.
+
+static const double overhead_ratio = 19.0; // transfer time / latencies
+static const uint64_t min_chunk = 1 << 20;
+static const uint64_t fallback_chunk = 8 << 20; // nothing could be measured
+static const uint32_t chunks_per_slot = 2; // load balancing, see Choose()
+
+typedef std::chrono::high_resolution_clock probe_clock;
+
+//*********************************************************************
+//
+// ChunkSizer Constructors/Destructors
+//
+//*********************************************************************
+//
+// Constructor(s)
+//
+ChunkSizer::ChunkSizer(OclEnv * env) : env(env) {}
+
+//
+// Destructor
+//
+ChunkSizer::~ChunkSizer(){}
+
+//
+// Empty if there is no cache directory, i.e. nothing is persisted
+//
+std::string ChunkSizer::ProbeFile()
+{
+  std::string dir = this->env->GetCacheDir();
+
+  return dir.empty() ? "" : dir + "/probe.txt";
+}
+
+//*********************************************************************
+//
+// ChunkSizer Probing
+//
+//*********************************************************************
+
+DeviceProbe ChunkSizer::Get(uint32_t device)
+{
+  DeviceProbe probe;
+
+  if (this->Load(device, &probe))
+    return probe;
+
+  probe = this->Probe(device);
+
+  if (probe.write_bw > 0 && probe.read_bw > 0)
+    this->Save(device, probe);
+
+  return probe;
+}
+
+//
+// Probe()
+//
+// Bandwidths come from the profiled duration of whole buffer writes and
+// reads (pageable host memory, as with -transfer=copy). The latency is the
+// host time from enqueueing a 4 B write, or a single work-item
+// PhiloxUniform launch, to its completion, whichever is larger: the fixed
+// cost every command of a chunk pays however small it is. A device that can
+// not be probed gets zero bandwidths, which Choose() ignores.
+//
+DeviceProbe ChunkSizer::Probe(uint32_t device)
+{
+  cl_int err;
+
+  cl::Device * dev = this->env->GetDevice(device);
+  cl::Context * cntxt = this->env->GetContext(device);
+  cl::CommandQueue * cq = this->env->GetCq(device);
+  cl::Kernel * gen = this->env->GetGenerateKernel(device);
+
+  DeviceProbe probe = {0, 0, 0, dev->getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>(),
+    dev->getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>()};
+
+  size_t size = std::min(probe_bytes, probe.max_alloc / 2) / sizeof(float) *
+    sizeof(float);
+  std::vector<float> host(size / sizeof(float), 1.0f);
+
+  cl::Buffer buffer((*cntxt), CL_MEM_READ_WRITE, size, NULL, &err);
+  if (CL_SUCCESS != err)
+  {
+    printf("Device %d: could not probe transfers (%s).\n", device,
+      this->env->OclErrorStrings(err).c_str());
+    return probe;
+  }
+
+  cl_ulong best_write = 0, best_read = 0;
+  double best_latency = 0;
+
+  for (uint32_t r = 0; r < 1 + probe_runs; r++)
+  {
+    cl::Event write, read;
+
+    err = cq->enqueueWriteBuffer(buffer, CL_FALSE, 0, size, host.data(), NULL,
+      &write);
+    if (CL_SUCCESS != err || CL_SUCCESS != write.wait())
+      return probe;
+
+    err = cq->enqueueReadBuffer(buffer, CL_FALSE, 0, size, host.data(), NULL,
+      &read);
+    if (CL_SUCCESS != err || CL_SUCCESS != read.wait())
+      return probe;
+
+    // latency of the smallest commands
+
+    double latency[2];
+
+    probe_clock::time_point t_start = probe_clock::now();
+
+    err = cq->enqueueWriteBuffer(buffer, CL_TRUE, 0, sizeof(float),
+      host.data());
+    if (CL_SUCCESS != err)
+      return probe;
+
+    latency[0] = std::chrono::duration<double>(
+      probe_clock::now() - t_start).count();
+
+    gen->setArg(0, buffer);
+    gen->setArg(1, static_cast<cl_ulong>(0));
+    gen->setArg(2, static_cast<cl_uint>(4));
+    gen->setArg(3, static_cast<cl_uint>(0));
+    gen->setArg(4, static_cast<cl_uint>(1));
+    gen->setArg(5, static_cast<cl_uint>(0));
+
+    cl::Event launch;
+    t_start = probe_clock::now();
+
+    err = cq->enqueueNDRangeKernel((*gen), cl::NDRange(0), cl::NDRange(1),
+      cl::NullRange, NULL, &launch);
+    if (CL_SUCCESS != err || CL_SUCCESS != launch.wait())
+      return probe;
+
+    latency[1] = std::chrono::duration<double>(
+      probe_clock::now() - t_start).count();
+
+    if (r == 0)
+      continue;
+
+    cl_ulong write_ns = write.getProfilingInfo<CL_PROFILING_COMMAND_END>() -
+      write.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    cl_ulong read_ns = read.getProfilingInfo<CL_PROFILING_COMMAND_END>() -
+      read.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+
+    if (write_ns > 0 && (best_write == 0 || write_ns < best_write))
+      best_write = write_ns;
+    if (read_ns > 0 && (best_read == 0 || read_ns < best_read))
+      best_read = read_ns;
+
+    double command = std::max(latency[0], latency[1]);
+    if (best_latency == 0 || command < best_latency)
+      best_latency = command;
+  }
+
+  if (best_write == 0 || best_read == 0)
+    return probe;
+
+  probe.write_bw = size / (best_write / 1e9);
+  probe.read_bw = size / (best_read / 1e9);
+  probe.latency = best_latency;
+
+  printf("Device %d: probed write %.3f (GB/s), read %.3f (GB/s), command \
+latency %.1f (us)\n", device, probe.write_bw / 1e9, probe.read_bw / 1e9,
+    probe.latency * 1e6);
+
+  return probe;
+}
+
+//*********************************************************************
+//
+// ChunkSizer Sizing
+//
+//*********************************************************************
+
+//
+// Choose()
+//
+// Every chunk pays (n_moved + 1) command latencies, its transfers and the
+// kernel, so the chunk must be large enough that its transfers take
+// overhead_ratio times as long, on the slowest link of any device. But the
+// devices should also get several chunks per buffer set each, or the
+// pipeline never fills and the faster devices can not take over work from
+// the slower ones; small data sets get smaller chunks. Every buffer set must
+// fit a quarter of the smallest device memory, and every buffer the maximum
+// allocation.
+//
+// Three buffer sets keep a write, a kernel and a read in flight. When the
+// chunk had to be made smaller than the latency bound a fourth helps hide
+// the latencies, if there is room for it.
+//
+ChunkChoice ChunkSizer::Choose(const std::vector<DeviceProbe> & probes,
+  uint64_t n, uint32_t element, uint64_t n_chunk, uint32_t depth,
+  uint32_t n_buffers, uint32_t n_moved)
+{
+  uint64_t total = n * element;
+  uint32_t moved = std::max<uint32_t>(n_moved, 1);
+  uint32_t buffers = std::max<uint32_t>(n_buffers, 1);
+
+  // bytes per buffer the chunk latencies call for
+
+  uint64_t latency_bound = 0;
+
+  for (uint32_t d = 0; d < probes.size(); d++)
+  {
+    const DeviceProbe * p = &probes.at(d);
+
+    if (p->write_bw <= 0 || p->read_bw <= 0)
+      continue;
+
+    double bw = std::min(p->write_bw, p->read_bw);
+    latency_bound = std::max(latency_bound, static_cast<uint64_t>(
+      overhead_ratio * (moved + 1) * p->latency * bw / moved));
+  }
+
+  if (latency_bound == 0)
+    latency_bound = fallback_chunk;
+
+  uint64_t bound = min_chunk;
+  while (bound < latency_bound)
+    bound *= 2;
+
+  ChunkChoice choice = {n_chunk, depth > 0 ? depth : 3};
+
+  uint64_t size = n_chunk * element;
+
+  if (n_chunk == 0)
+  {
+    uint64_t n_devices = std::max<uint64_t>(probes.size(), 1);
+    uint64_t balanced = total / (chunks_per_slot * choice.depth * n_devices);
+
+    size = std::min(bound, std::max(balanced, min_chunk));
+  }
+
+  // device memory limits, which also decide on a fourth buffer set
+
+  uint64_t memory = UINT64_MAX;
+  uint64_t max_alloc = UINT64_MAX;
+
+  for (uint32_t d = 0; d < probes.size(); d++)
+  {
+    memory = std::min(memory, probes.at(d).global_mem / 4);
+    max_alloc = std::min(max_alloc, probes.at(d).max_alloc);
+  }
+
+  if (depth == 0 && size < bound && memory / (buffers * size) >= 4)
+    choice.depth = 4;
+
+  if (n_chunk == 0)
+  {
+    size = std::min(size, std::min(max_alloc,
+      memory / (buffers * choice.depth)));
+
+    // whole pages where possible, and at most the whole data set
+    size = size >= 4096 ? size / 4096 * 4096 : size;
+    choice.n_chunk = std::min<uint64_t>(std::min<uint64_t>(
+      std::max<uint64_t>(size / element, 1), n), UINT32_MAX);
+  }
+  else if (depth == 0)
+  {
+    choice.depth = std::max<uint64_t>(1, std::min<uint64_t>(choice.depth,
+      memory / (buffers * size)));
+  }
+
+  return choice;
+}
+
+//*********************************************************************
+//
+// ChunkSizer Persistence
+//
+//*********************************************************************
+
+//
+// probe.txt holds one line per device name:
+//
+//   <CL_DEVICE_NAME>\t<write B/s> <read B/s> <latency s>
+//
+// The memory limits are not persisted, they are queried every time.
+//
+bool ChunkSizer::Load(uint32_t device, DeviceProbe * probe)
+{
+  std::string file_name = this->ProbeFile();
+
+  if (file_name.empty())
+    return false;
+
+  cl::Device * dev = this->env->GetDevice(device);
+  std::string fields;
+
+  if (!OclEnv::LoadKeyedLine(file_name, dev->getInfo<CL_DEVICE_NAME>(),
+    &fields))
+    return false;
+
+  std::istringstream f_stream(fields);
+
+  if (!(f_stream >> probe->write_bw >> probe->read_bw >> probe->latency) ||
+    probe->write_bw <= 0 || probe->read_bw <= 0 || probe->latency < 0)
+    return false;
+
+  probe->max_alloc = dev->getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+  probe->global_mem = dev->getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+
+  printf("Device %d: probed before, write %.3f (GB/s), read %.3f (GB/s), \
+command latency %.1f (us)\n", device, probe->write_bw / 1e9,
+    probe->read_bw / 1e9, probe->latency * 1e6);
+
+  return true;
+}
+
+//
+// Replaces (or adds) device's line.
+//
+void ChunkSizer::Save(uint32_t device, const DeviceProbe & probe)
+{
+  std::string file_name = this->ProbeFile();
+
+  if (file_name.empty())
+    return;
+
+  std::ostringstream fields;
+  fields << probe.write_bw << ' ' << probe.read_bw << ' ' << probe.latency;
+
+  OclEnv::SaveKeyedLine(file_name,
+    this->env->GetDevice(device)->getInfo<CL_DEVICE_NAME>(), fields.str());
+}
+
+//EOF
@@ -0,0 +1,92 @@
+/*
+# chunksizer.h
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef  OCLPTX_CHUNKSIZER_H_
+#define  OCLPTX_CHUNKSIZER_H_
+
+#include <string>
+#include <vector>
+
+#include <CL/cl.hpp>
+
+#include "oclenv.h"
+
+//
+// Picks the chunk size and pipeline depth of a job from the devices' memory
+// limits (CL_DEVICE_MAX_MEM_ALLOC_SIZE, CL_DEVICE_GLOBAL_MEM_SIZE) and a short
+// probe of each device's transfer bandwidth and per command latency. Probe
+// results are remembered per device name in probe.txt in the kernel cache
+// directory, so the probe only runs once per device.
+//
+
+struct DeviceProbe
+{
+  double write_bw; // host -> device (B/s)
+  double read_bw; // device -> host (B/s)
+  double latency; // smallest write or launch, enqueue to completion (s)
+  uint64_t max_alloc; // CL_DEVICE_MAX_MEM_ALLOC_SIZE (B)
+  uint64_t global_mem; // CL_DEVICE_GLOBAL_MEM_SIZE (B)
+};
+
+struct ChunkChoice
+{
+  uint64_t n_chunk; // elements per chunk
+  uint32_t depth; // buffer sets per device
+};
+
+class ChunkSizer{
+
+  public:
+
+    ChunkSizer(OclEnv * env);
+
+    ~ChunkSizer();
+
+    // The persisted probe of device if there is one, otherwise probes it
+    // (and persists the result).
+    DeviceProbe Get(uint32_t device);
+
+    // Measures device, takes about a second at most.
+    DeviceProbe Probe(uint32_t device);
+
+    //
+    // Chooses for n elements of element bytes each per array spread over the
+    // probed devices, with n_buffers device buffers per buffer set of which
+    // n_moved are transferred per chunk. n_chunk or depth, if not 0, are
+    // fixed and only the other one is chosen.
+    //
+    static ChunkChoice Choose(const std::vector<DeviceProbe> & probes,
+      uint64_t n, uint32_t element, uint64_t n_chunk, uint32_t depth,
+      uint32_t n_buffers, uint32_t n_moved);
+
+    std::string ProbeFile();
+
+  private:
+
+    bool Load(uint32_t device, DeviceProbe * probe);
+
+    void Save(uint32_t device, const DeviceProbe & probe);
+
+    OclEnv * env;
+};
+
+#endif
+
+//EOF
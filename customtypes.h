@@ -21,6 +21,12 @@
 #ifndef OCLPTX_CUSTOMTYPES_H_
 #define OCLPTX_CUSTOMTYPES_H_
 
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
 struct float3
 {
   float x, y, z;
@@ -33,19 +39,249 @@ struct float4
 
 struct int3
 {
-  float x, y, z;
+  int32_t x, y, z;
 };
 
 struct int4
 {
-  float x, y, z, t;
+  int32_t x, y, z, t;
+};
+
+//
+// Element types of a data set (-type=). The structs above are summed
+// component-wise, so on the devices they are arrays of their component type:
+// only float, double, int and long kernels are ever built (-DT=, see
+// kernels/elementwise.cl).
+//
+enum ElementType
+{
+  TYPE_FLOAT,
+  TYPE_DOUBLE,
+  TYPE_INT,
+  TYPE_LONG,
+  TYPE_FLOAT3,
+  TYPE_FLOAT4,
+  TYPE_INT3,
+  TYPE_INT4,
+  N_TYPES
+};
+
+template <typename T>
+struct ElementTraits;
+
+template <>
+struct ElementTraits<float>
+{
+  typedef float Component;
+  static const uint32_t type = TYPE_FLOAT;
+};
+
+template <>
+struct ElementTraits<double>
+{
+  typedef double Component;
+  static const uint32_t type = TYPE_DOUBLE;
+};
+
+template <>
+struct ElementTraits<int32_t>
+{
+  typedef int32_t Component;
+  static const uint32_t type = TYPE_INT;
+};
+
+template <>
+struct ElementTraits<int64_t>
+{
+  typedef int64_t Component;
+  static const uint32_t type = TYPE_LONG;
+};
+
+template <>
+struct ElementTraits<float3>
+{
+  typedef float Component;
+  static const uint32_t type = TYPE_FLOAT3;
+};
+
+template <>
+struct ElementTraits<float4>
+{
+  typedef float Component;
+  static const uint32_t type = TYPE_FLOAT4;
+};
+
+template <>
+struct ElementTraits<int3>
+{
+  typedef int32_t Component;
+  static const uint32_t type = TYPE_INT3;
+};
+
+template <>
+struct ElementTraits<int4>
+{
+  typedef int32_t Component;
+  static const uint32_t type = TYPE_INT4;
+};
+
+struct ElementInfo
+{
+  const char * name; // -type= name
+  uint32_t size; // bytes per element
+  uint32_t component; // ElementType of the components
+  uint32_t components; // per element
+  const char * cl_type; // OpenCL C name of the component type
+};
+
+template <typename T>
+ElementInfo MakeElementInfo(const char * name)
+{
+  typedef typename ElementTraits<T>::Component C;
+
+  const char * cl_types[] = {"float", "double", "int", "long"};
+
+  ElementInfo info = {name, sizeof(T), ElementTraits<C>::type,
+    sizeof(T) / sizeof(C), cl_types[ElementTraits<C>::type]};
+
+  return info;
+}
+
+// TYPE_FLOAT's for anything out of range
+inline const ElementInfo & GetElementInfo(uint32_t type)
+{
+  static const ElementInfo info[N_TYPES] = {
+    MakeElementInfo<float>("float"),
+    MakeElementInfo<double>("double"),
+    MakeElementInfo<int32_t>("int"),
+    MakeElementInfo<int64_t>("long"),
+    MakeElementInfo<float3>("float3"),
+    MakeElementInfo<float4>("float4"),
+    MakeElementInfo<int3>("int3"),
+    MakeElementInfo<int4>("int4")
+  };
+
+  return info[type < N_TYPES ? type : TYPE_FLOAT];
+}
+
+//
+// How the vector types' components sit in the device buffers (-layout=).
+// The host arrays are always interleaved, the device side of a chunk can be
+// transposed on the host on the way there and back (HostBackend::ToSoA).
+//
+enum Layout
+{
+  LAYOUT_AOS, // as on the host, x0 y0 z0 x1 ..., with no padding
+  LAYOUT_SOA  // per chunk one array per component, x0 x1 ... y0 y1 ...
+};
+
+enum TransferMode
+{
+  TRANSFER_COPY,     // enqueueWrite/ReadBuffer from pageable host memory
+  TRANSFER_PINNED,   // via CL_MEM_ALLOC_HOST_PTR staging buffers
+  TRANSFER_ZEROCOPY  // CL_MEM_USE_HOST_PTR over the host arrays
+};
+
+//
+// Page aligned allocator for the host arrays, so that CL_MEM_USE_HOST_PTR
+// buffers created over them can be used in place by the driver.
+//
+template <typename T>
+struct PageAlignedAllocator
+{
+  typedef T value_type;
+
+  PageAlignedAllocator() {}
+
+  template <typename U>
+  PageAlignedAllocator(const PageAlignedAllocator<U> &) {}
+
+  T * allocate(size_t n)
+  {
+    void * ptr = NULL;
+    if (posix_memalign(&ptr, 4096, n * sizeof(T)) != 0)
+      throw std::bad_alloc();
+    return static_cast<T*>(ptr);
+  }
+
+  void deallocate(T * ptr, size_t) { free(ptr); }
+};
+
+template <typename T, typename U>
+bool operator==(const PageAlignedAllocator<T> &,
+  const PageAlignedAllocator<U> &)
+{
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const PageAlignedAllocator<T> &,
+  const PageAlignedAllocator<U> &)
+{
+  return false;
+}
+
+typedef std::vector<float, PageAlignedAllocator<float> > HostArray;
+
+enum QueueMode
+{
+  QUEUE_SINGLE, // writes, kernels and reads share one queue per device
+  QUEUE_MULTI   // host->device, compute and device->host queues per device
+};
+
+enum GenerateMode
+{
+  GENERATE_HOST,   // Philox on the host, uploaded with the chunks
+  GENERATE_DEVICE  // Philox kernel straight into the device buffers
+};
+
+//
+// Element-wise kernel specialisation, see kernels/elementwise.cl
+//
+struct KernelConfig
+{
+  uint32_t vec; // floatn width: 1, 2, 4, 8 or 16
+  uint32_t elems; // vectors per work-item
+  bool grid_stride; // grid-stride loop over the chunk, elems unused
+  uint32_t local; // work-group size, 0: left to the driver
 };
 
 struct ConfigData
 {
-  float data_size;
-  float chunk_size;
+  uint64_t data_size; // bytes
+  uint64_t chunk_size; // bytes
   std::vector<uint32_t> gpu_select;
+  uint32_t pipeline_depth;
+  uint64_t device_type; // cl_device_type, CL_DEVICE_TYPE_* to look for
+  int32_t platform; // platform index to use, if negative: all platforms
+  uint32_t transfer_mode; // TransferMode
+  std::string kernel_cache; // binary cache dir, "off" disables, empty: default
+  bool profile; // print a per device, per stage profile summary
+  std::string trace_file; // Chrome trace output, empty: none
+  uint32_t warmup; // untimed runs
+  uint32_t repeat; // timed runs
+  std::string results_file; // CSV results, empty: none
+  bool host_engine; // host backend takes chunks alongside the devices
+  uint32_t host_threads; // host backend threads, 0: all
+  bool verify; // full output verification
+  uint32_t generate_mode; // GenerateMode
+  uint64_t seed; // input generator seed
+  bool autotune; // benchmark kernel variants instead of using tuning.txt
+  std::vector<std::string> in_files; // streamed operands, empty: generated
+  std::vector<std::string> out_files; // streamed results, empty: in memory
+  std::string op; // KernelRegistry name of the element-wise operation
+  std::vector<double> params; // scalar parameters of op, empty: defaults
+  std::string expr; // fused expression graph, replaces op if not empty
+  uint32_t reduce; // ReduceKind
+  uint32_t queue_mode; // QueueMode
+  uint32_t wire; // WireFormat of the transfers
+  bool in_place; // the first output overwrites the first input
+  uint32_t type; // ElementType of the data set
+  uint32_t layout; // Layout of vector elements on the devices
+  uint32_t retries; // of a failed chunk, before the run is given up
+  uint32_t quarantine; // chunk failures in a row that take a device out
+  double fault_rate; // chance of an injected failure per chunk attempt
+  int32_t fault_device; // device the faults are injected on, if negative: all
 };
 
 #endif
@@ -0,0 +1,1701 @@
+/*
+# executor.cc
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+#include <CL/cl.hpp>
+
+#include "executor.h"
+#include "autotune.h"
+#include "profiler.h"
+#include "scheduler.h"
+
+// The operation a run performs and the arrays it works on. With on-device
+// generation the inputs are NULL and every chunk's inputs are produced from
+// (seed, input index, element index) instead.
+
+struct ChunkData
+{
+  const KernelSignature * op;
+  std::vector<double> params; // op's scalar parameters
+
+  std::vector<const void *> in; // op->n_inputs arrays
+  std::vector<void *> out; // op->n_outputs arrays
+  uint32_t type; // ElementType of their elements
+  uint32_t size; // bytes per element in the arrays
+  uint32_t components; // per vector element, whole ones in every chunk
+  uint32_t layout; // Layout on the devices, LAYOUT_AOS for scalars
+  uint64_t n; // elements per array
+  uint32_t n_chunks;
+  uint32_t n_chunk; // elements per chunk, the last one may hold fewer
+  bool generate;
+  uint64_t seed;
+
+  // the files behind in and out when they are memory mapped, NULL otherwise
+  std::vector<MappedFile *> map_in;
+  std::vector<MappedFile *> map_out;
+  uint32_t prefetch; // chunks read ahead of the newest one claimed
+
+  // ReduceKind; with a reduction there are no output arrays, each chunk's
+  // result goes to reduced[chunk] instead
+  uint32_t reduce;
+  double * reduced;
+
+  // WireFormat of the device buffers, element bytes on the device and the
+  // host backend that converts to and from it
+  uint32_t wire;
+  uint32_t element;
+  HostBackend * host;
+
+  bool in_place; // output 0 is written over input 0
+
+  // failover, see ChunkScheduler, and the faults injected to test it
+  uint32_t retries;
+  uint32_t quarantine;
+  double fault_rate;
+  int32_t fault_device; // if negative: every device
+};
+
+// One set of device buffers plus the events of the chunk that last used it.
+// Each device has pipeline_depth slots, so consecutive chunks on a device use
+// different buffers and their write/kernel/read commands can overlap.
+
+struct BufferSlot
+{
+  std::vector<cl::Buffer> in; // one per kernel input
+  std::vector<cl::Buffer> out; // one per kernel output
+
+  uint32_t mode; // TransferMode used by this slot's device
+
+  // out.at(0) is in.at(0), and so are their staging buffers if the input
+  // has any. Not with zero copy and generated inputs, whose outputs wrap host
+  // memory anyway.
+  bool in_place;
+
+  // Staging that the writes DMA from and the reads to, NULL if there is
+  // none. TRANSFER_PINNED: CL_MEM_ALLOC_HOST_PTR buffers, mapped for the
+  // lifetime of the slot. TRANSFER_COPY with a 16 bit wire format or the
+  // SoA layout: stage_in and stage_out, for the converted elements.
+  std::vector<cl::Buffer> pin_in;
+  std::vector<cl::Buffer> pin_out;
+  std::vector< std::vector<uint64_t> > stage_in;
+  std::vector< std::vector<uint64_t> > stage_out;
+  std::vector<void *> host_in;
+  std::vector<void *> host_out;
+
+  // TRANSFER_ZEROCOPY: outputs stay mapped for reading until the slot drains
+  std::vector<void *> mapped_out;
+
+  // reductions: the work-group partials of the chunk, on the device and as
+  // read back, and the reduction's work-group size
+  cl::Buffer partials;
+  std::vector<float> host_partials;
+  uint32_t reduce_local;
+
+  std::vector<void *> dest; // where the in flight chunk's outputs belong
+  uint32_t chunk; // the in flight chunk
+  uint32_t length; // elements of the in flight chunk
+  uint64_t size; // bytes per buffer, a whole chunk
+
+  std::vector<cl::Event> write_events; // one write (or generate kernel) per
+                                       // input
+  std::vector<cl::Event> kernel_event; // the last kernel of the chunk
+  cl::Event op_event; // the operation, when a reduction kernel follows it
+  std::vector<cl::Event> read_events; // one read (or map) per output, each
+                                      // after the one before, so the last
+                                      // one completing drains the slot
+
+  bool used; // false until the first chunk has been enqueued on this slot
+  bool busy; // true while a chunk is in flight on this slot
+
+  // handed to the read event callback so it can report which slot drained
+  ChunkScheduler * scheduler;
+  uint32_t device;
+  uint32_t index;
+  uint64_t bytes; // moved by the in flight chunk
+};
+
+void CL_CALLBACK SlotDrained(cl_event event, cl_int status, void * user_data);
+
+double RunChunks(OclEnv * env, std::vector<uint32_t> & gpus,
+  std::vector< std::vector<BufferSlot> > * slots, Profiler * profiler,
+  HostBackend * host, const ChunkData & data, bool report,
+  std::vector<bool> * quarantined, bool * completed);
+
+void DeviceWorker(OclEnv * env, uint32_t device, uint32_t engine,
+  std::vector<BufferSlot> * slots, Profiler * profiler,
+  ChunkScheduler * scheduler, const ChunkData * data,
+  cl::NDRange global_range, cl::NDRange local_range);
+
+void HostWorker(HostBackend * host, ChunkScheduler * scheduler,
+  uint32_t engine, const ChunkData * data);
+
+bool ChunkFailed(OclEnv * env, uint32_t device, uint32_t engine,
+  ChunkScheduler * scheduler, uint32_t c, cl_int status, bool stopped);
+
+cl_int CreateSlotBuffers(BufferPool * pool, cl::Context * cntxt,
+  cl::CommandQueue * cq, BufferSlot * slot, const ChunkData & data);
+
+void ReleaseSlotBuffers(BufferPool * pool, cl::CommandQueue * cq,
+  BufferSlot * slot);
+
+cl_int EnqueueChunk(cl::Context * cntxt, cl::CommandQueue * h2d,
+  cl::CommandQueue * cq, cl::CommandQueue * d2h, cl::Kernel * kern,
+  cl::Kernel * gen, cl::Kernel * red, BufferSlot * slot,
+  const ChunkData & data, uint32_t c, cl::NDRange global_range,
+  cl::NDRange local_range);
+
+cl_int FinishChunk(cl::CommandQueue * cq, BufferSlot * slot,
+  const ChunkData & data);
+
+void AbandonChunk(cl::CommandQueue * h2d, cl::CommandQueue * cq,
+  cl::CommandQueue * d2h, BufferSlot * slot);
+
+uint32_t ChunkLength(const ChunkData & data, uint32_t c);
+
+uint32_t DeviceElementSize(const StreamJob & job);
+
+uint32_t DeviceBuffers(const StreamJob & job);
+
+uint32_t MovedOperands(const StreamJob & job);
+
+const void * ElementAt(const ChunkData & data, const void * array,
+  uint64_t i);
+
+void * ElementAt(const ChunkData & data, void * array, uint64_t i);
+
+void PrefetchChunk(const ChunkData & data, uint32_t c);
+
+void ReleaseChunk(const ChunkData & data, uint32_t c);
+
+//*********************************************************************
+//
+// StreamingExecutor Constructors/Destructors
+//
+//*********************************************************************
+//
+// Constructor(s)
+//
+// Everything that does not depend on a job happens here, once: platform and
+// device discovery, contexts and queues, the device selection and the host
+// backend.
+//
+StreamingExecutor::StreamingExecutor(const ConfigData & config) :
+  config(config), host(config.host_threads), reduce_kernel(REDUCE_NONE),
+  stopping(false)
+{
+  this->env.OclInit(config.device_type, config.platform);
+
+  this->env.OclDeviceInfo();
+
+  this->env.NewCLCommandQueues(QUEUE_MULTI == config.queue_mode);
+
+  if (config.kernel_cache == "off")
+    this->env.SetCacheDir("");
+  else if (!config.kernel_cache.empty())
+    this->env.SetCacheDir(config.kernel_cache);
+
+  printf("N_Devices: %lu\n", config.gpu_select.size());
+
+  // might seem superfluous but I'm validating the CLI input here against the
+  // actual environment, so that the code doesn't try to use nonexistent
+  // GPU #10000, etc
+  this->env.SetGPUs(config.gpu_select);
+
+  this->gpus = this->env.GetGPUs();
+  this->quarantined.assign(this->gpus.size(), false);
+
+  printf("OpenCL CommandQueues ready.\n");
+
+  if (config.host_engine)
+    printf("Host engine: %s, %d threads\n", this->host.IsaString().c_str(),
+      this->host.HowManyThreads());
+
+  this->dispatcher = std::thread(&StreamingExecutor::Dispatch, this);
+}
+
+//
+// Destructor
+//
+StreamingExecutor::~StreamingExecutor()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->queue_mutex);
+    this->stopping = true;
+  }
+  this->queue_cv.notify_all();
+
+  this->dispatcher.join();
+}
+
+//*********************************************************************
+//
+// StreamingExecutor Jobs
+//
+//*********************************************************************
+
+std::future<JobResult> StreamingExecutor::Submit(const StreamJob & job)
+{
+  QueuedJob * queued = new QueuedJob;
+  queued->job = job;
+
+  std::future<JobResult> result = queued->promise.get_future();
+
+  {
+    std::lock_guard<std::mutex> lock(this->queue_mutex);
+    this->queue.push_back(queued);
+  }
+  this->queue_cv.notify_all();
+
+  return result;
+}
+
+void StreamingExecutor::Submit(const StreamJob & job,
+  std::function<void(const JobResult &)> done)
+{
+  QueuedJob * queued = new QueuedJob;
+  queued->job = job;
+  queued->done = done;
+
+  {
+    std::lock_guard<std::mutex> lock(this->queue_mutex);
+    this->queue.push_back(queued);
+  }
+  this->queue_cv.notify_all();
+}
+
+std::vector<uint32_t> StreamingExecutor::GetGPUs()
+{
+  return this->gpus;
+}
+
+HostBackend * StreamingExecutor::GetHost()
+{
+  return &this->host;
+}
+
+//
+// Dispatcher thread: runs the queued jobs in submission order, until the
+// executor is destroyed and the queue is empty.
+//
+void StreamingExecutor::Dispatch()
+{
+  while (true)
+  {
+    QueuedJob * queued;
+
+    {
+      std::unique_lock<std::mutex> lock(this->queue_mutex);
+      this->queue_cv.wait(lock, [this]{
+        return this->stopping || !this->queue.empty();
+      });
+
+      if (this->queue.empty())
+        return;
+
+      queued = this->queue.front();
+      this->queue.pop_front();
+    }
+
+    JobResult result = this->Execute(queued->job);
+
+    if (queued->done)
+      queued->done(result);
+    else
+      queued->promise.set_value(result);
+
+    delete queued;
+  }
+}
+
+//
+// Kernels stay built between jobs of the same operation and reduction.
+// Chunks are sized once the kernels exist, the probe launches one of them.
+// Autotuning, if enabled, happens once per operation and chunk size; other
+// jobs use the saved variant.
+//
+void StreamingExecutor::Prepare(StreamJob * job, uint32_t * depth)
+{
+  // 16 bit wire formats run the op's variant over half or ushort buffers
+  const KernelSignature * op = job->op;
+
+  if (WIRE_FP32 != job->wire)
+  {
+    this->wire_op = *job->op;
+    this->wire_op.entry += WIRE_FP16 == job->wire ? "Half" : "Bf16";
+    op = &this->wire_op;
+  }
+
+  std::string key = op->entry + op->generated;
+  bool rebuilt = false;
+
+  if (job->reduce != this->reduce_kernel)
+  {
+    const char * entries[] = {"", "ReduceSum", "ReduceMin", "ReduceMax",
+      "ReduceDot"};
+
+    this->env.CreateReduceKernels(entries[job->reduce]);
+    this->reduce_kernel = job->reduce;
+  }
+
+  // other element types than float get their own build of the kernel
+  if (TYPE_FLOAT != job->type)
+    key += std::string("<") + GetElementInfo(job->type).cl_type + ">";
+
+  if (key != this->kernel_key)
+  {
+    this->env.CreateKernels(*op, job->type);
+    this->kernel_key = key;
+    rebuilt = true;
+  }
+
+  *depth = this->config.pipeline_depth;
+  if (job->n_chunk == 0 || *depth == 0)
+    this->SizeChunks(job, depth);
+
+  // whole vector elements per chunk, so each chunk transposes on its own
+  if (job->components > 1)
+    job->n_chunk = std::max(job->components,
+      job->n_chunk - job->n_chunk % job->components);
+
+  std::string tune_key = key + "/" + std::to_string(job->n_chunk);
+  bool tune = this->config.autotune && std::find(this->tuned.begin(),
+    this->tuned.end(), tune_key) == this->tuned.end();
+
+  if (!rebuilt && !tune)
+    return;
+
+  // Kernel variant per device: freshly tuned for this chunk size, else
+  // whatever was tuned before, else one element per work-item
+
+  Autotuner tuner(&this->env);
+
+  for (uint32_t d = 0; d < this->gpus.size(); d++)
+  {
+    if (tune)
+      tuner.Save(this->gpus.at(d), tuner.Tune(this->gpus.at(d),
+        job->n_chunk));
+    else
+      tuner.Load(this->gpus.at(d));
+  }
+
+  if (tune)
+    this->tuned.push_back(tune_key);
+}
+
+//
+// The devices are probed the first time a job needs sizing (or their probes
+// loaded from the kernel cache), every later job reuses the results.
+//
+void StreamingExecutor::SizeChunks(StreamJob * job, uint32_t * depth)
+{
+  if (this->probes.empty())
+  {
+    ChunkSizer sizer(&this->env);
+
+    for (uint32_t d = 0; d < this->gpus.size(); d++)
+      this->probes.push_back(sizer.Get(this->gpus.at(d)));
+  }
+
+  uint32_t n_buffers = DeviceBuffers(*job);
+  uint32_t n_moved = MovedOperands(*job);
+
+  ChunkChoice choice = ChunkSizer::Choose(this->probes, job->n,
+    DeviceElementSize(*job), job->n_chunk, *depth, n_buffers, n_moved);
+
+  if (job->n_chunk == 0)
+    printf("Automatic chunk size: %.3f (MB)\n",
+      static_cast<double>(choice.n_chunk) * GetElementInfo(job->type).size /
+      1e6);
+  if (*depth == 0)
+    printf("Automatic pipeline depth: %d\n", choice.depth);
+
+  job->n_chunk = choice.n_chunk;
+  *depth = choice.depth;
+}
+
+//
+// Runs one job: its buffer sets are taken from the device pools, the data is
+// passed config.warmup + config.repeat times, and the buffers go back to the
+// pools for the next job.
+//
+JobResult StreamingExecutor::Execute(const StreamJob & submitted)
+{
+  StreamJob job = submitted;
+  uint32_t depth;
+
+  this->Prepare(&job, &depth);
+
+  OclEnv * env = &this->env;
+  std::vector<uint32_t> & gpus = this->gpus;
+
+  uint32_t n_in = job.op->n_inputs;
+  uint32_t n_out = job.op->n_outputs;
+  uint32_t n_chunk = job.n_chunk;
+  uint32_t n_chunks = (job.n + n_chunk - 1) / n_chunk;
+
+  ChunkData data;
+
+  data.op = job.op;
+  data.params = job.params;
+  data.in = job.in;
+  data.out = job.out;
+  data.type = job.type;
+  data.size = GetElementInfo(job.type).size;
+  data.components = job.components;
+  data.layout = job.components > 1 ? job.layout : LAYOUT_AOS;
+  data.n = job.n;
+  data.n_chunks = n_chunks;
+  data.n_chunk = n_chunk;
+  data.generate = job.generate;
+  data.seed = job.seed;
+  data.map_in = job.map_in;
+  data.map_out = job.map_out;
+  data.prefetch = 0;
+
+  std::vector<double> reduced(n_chunks);
+  data.reduce = job.reduce;
+  data.reduced = reduced.data();
+
+  data.wire = job.wire;
+  data.element = DeviceElementSize(job);
+  data.host = &this->host;
+
+  data.in_place = job.in_place;
+
+  // Over host inputs, a chunk written in place is not retried: its failed
+  // read back may have overwritten part of its input already.
+  data.retries = job.in_place && !job.generate ? 0 : this->config.retries;
+  data.quarantine = std::max(1U, this->config.quarantine);
+  data.fault_rate = this->config.fault_rate;
+  data.fault_device = this->config.fault_device;
+
+  uint64_t buffer_mem_size = static_cast<uint64_t>(n_chunk) * data.element;
+
+  printf("N Chunks: %d, Chunk Buffer Size: %llu (B), Pipeline Depth: %d\n",
+    n_chunks, static_cast<unsigned long long>(buffer_mem_size), depth);
+
+  if (job.n % n_chunk)
+    printf("Last chunk: %llu elements\n",
+      static_cast<unsigned long long>(job.n % n_chunk));
+
+  if (TRANSFER_ZEROCOPY == this->config.transfer_mode && buffer_mem_size % 4096)
+    puts("Chunk size is not a multiple of 4096 B, zero copy buffers after the \
+first may not be page aligned and could be copied by the driver.");
+
+  // OpenCL setup and kernel execution
+
+  cl_int err;
+
+  // a device quarantined in an earlier job gets another chance
+  this->quarantined.assign(gpus.size(), false);
+
+  std::vector<cl::Context*> cntxts;
+  std::vector<cl::CommandQueue*> cqs;
+
+  // slots.at(d).at(s) is buffer set s of device d
+
+  std::vector< std::vector<BufferSlot> > slots;
+
+  for (uint32_t d = 0; d < gpus.size(); d++)
+  {
+    cntxts.push_back(env->GetContext(gpus.at(d)));
+    cqs.push_back(env->GetCq(gpus.at(d)));
+
+    slots.push_back(std::vector<BufferSlot>(depth));
+
+    // zero copy only pays off where the device works out of host memory,
+    // discrete devices get pinned staging buffers instead, as do 16 bit wire
+    // formats and the SoA layout, whose conversions need somewhere to go
+
+    uint32_t mode = this->config.transfer_mode;
+    if (TRANSFER_ZEROCOPY == mode &&
+      !env->GetDevice(gpus.at(d))->getInfo<CL_DEVICE_HOST_UNIFIED_MEMORY>())
+    {
+      printf("Device %d does not share host memory, using pinned transfers.\n",
+        gpus.at(d));
+      mode = TRANSFER_PINNED;
+    }
+    else if (TRANSFER_ZEROCOPY == mode && WIRE_FP32 != job.wire)
+    {
+      printf("Device %d: zero copy needs float buffers, using pinned \
+transfers.\n", gpus.at(d));
+      mode = TRANSFER_PINNED;
+    }
+    else if (TRANSFER_ZEROCOPY == mode && LAYOUT_SOA == data.layout)
+    {
+      printf("Device %d: zero copy needs the host layout, using pinned \
+transfers.\n", gpus.at(d));
+      mode = TRANSFER_PINNED;
+    }
+
+    // Set up data container OpenCL buffers, carved out of the device's pool.
+    // Zero copy slots mostly wrap host memory and reserve nothing up front.
+
+    uint64_t partials_size = 0;
+    uint32_t n_reduce_local;
+    if (REDUCE_NONE != job.reduce)
+      partials_size = env->ReduceRange(gpus.at(d), n_chunk, &n_reduce_local) *
+        sizeof(float);
+
+    uint32_t n_buffers = DeviceBuffers(job);
+
+    if (TRANSFER_ZEROCOPY != mode)
+    {
+      err = env->GetPool(gpus.at(d))->Reserve(depth *
+        (n_buffers * buffer_mem_size + partials_size),
+        depth * (n_buffers + 1));
+      if (CL_SUCCESS != err)
+        printf("Device %d: could not reserve a buffer pool (%s), using \
+separate buffers.\n", gpus.at(d), env->OclErrorStrings(err).c_str());
+    }
+
+    for (uint32_t s = 0; s < depth; s++)
+    {
+      BufferSlot * slot = &slots.back().at(s);
+
+      slot->mode = mode;
+      slot->size = buffer_mem_size;
+
+      if (REDUCE_NONE != job.reduce)
+        slot->host_partials.resize(env->ReduceRange(gpus.at(d), n_chunk,
+          &slot->reduce_local));
+
+      err = CreateSlotBuffers(env->GetPool(gpus.at(d)), cntxts.back(),
+        cqs.back(), slot, data);
+      if (CL_SUCCESS != err)
+      {
+        printf("Device %d: could not create its buffers (%s), quarantined\n",
+          gpus.at(d), env->OclErrorStrings(err).c_str());
+        this->quarantined.at(d) = true;
+
+        // the device sits the job out with no slots
+        for (uint32_t r = 0; r <= s; r++)
+          ReleaseSlotBuffers(env->GetPool(gpus.at(d)), cqs.back(),
+            &slots.back().at(r));
+        cqs.back()->finish();
+        slots.back().clear();
+        break;
+      }
+
+      slot->write_events.resize(n_in);
+      slot->kernel_event.resize(1);
+      slot->read_events.resize(REDUCE_NONE != job.reduce ? 1 : n_out);
+      slot->used = false;
+    }
+  }
+
+  if (!gpus.empty() && !this->config.host_engine &&
+    std::count(this->quarantined.begin(), this->quarantined.end(), false) == 0)
+    env->Die(err, "No device could create its buffers.");
+
+  // streamed files are read one chunk ahead of every consumer
+
+  data.prefetch = depth * gpus.size() + (this->config.host_engine ? 1 : 0);
+
+  // Execute the work sets, warmup runs first, then the measured repeats.
+  // Only the last run is profiled.
+
+  Profiler profiler;
+  bool profiling = this->config.profile || !this->config.trace_file.empty();
+
+  uint32_t n_runs = this->config.warmup + this->config.repeat;
+
+  JobResult result;
+
+  result.n_chunk = n_chunk;
+  result.depth = depth;
+  result.completed = true;
+
+  result.moved = static_cast<double>(MovedOperands(job)) * job.n *
+    data.element;
+
+  for (uint32_t run = 0; run < n_runs; run++)
+  {
+    bool last = (run + 1 == n_runs);
+
+    profiler.Enable(profiling && last);
+
+    bool completed;
+    double elapsed = RunChunks(env, gpus, &slots, &profiler,
+      this->config.host_engine ? &this->host : NULL, data, last,
+      &this->quarantined, &completed);
+
+    if (!completed)
+    {
+      printf("Run %d failed: a chunk failed %d times, or no device is left.\n",
+        run, data.retries + 1);
+      result.completed = false;
+      break;
+    }
+
+    printf("Run %d%s: Elapsed: %.4f (s), Throughput: %.3f (GB/s)\n", run,
+      run < this->config.warmup ? " (warmup)" : "", elapsed,
+      result.moved / elapsed / 1e9);
+
+    if (run >= this->config.warmup)
+      result.run_times.push_back(elapsed);
+  }
+
+  // unmap the pinned staging and hand the device buffers back for the next
+  // job
+
+  for (uint32_t d = 0; d < gpus.size(); d++)
+  {
+    BufferPool * pool = env->GetPool(gpus.at(d));
+
+    for (uint32_t s = 0; s < slots.at(d).size(); s++)
+      ReleaseSlotBuffers(pool, cqs.at(d), &slots.at(d).at(s));
+
+    cqs.at(d)->finish();
+
+    PoolStats stats = pool->Stats();
+
+    printf("Device %d buffer pool: arena %.3f (MB), high water %.3f (MB), \
+%d sub-buffers carved, %d reused, %d separate\n", gpus.at(d),
+      stats.arena / 1e6, stats.high_water / 1e6, stats.carved, stats.reused,
+      stats.overflow);
+  }
+
+  if (profiler.Enabled())
+  {
+    err = profiler.Collect();
+    if (CL_SUCCESS != err)
+      env->Die(err, "Could not read event profiling info.");
+
+    profiler.PrintSummary(gpus);
+
+    if (!this->config.trace_file.empty())
+      profiler.WriteTrace(this->config.trace_file, gpus);
+  }
+
+  // reductions: every chunk's result, combined in chunk order so the result
+  // does not depend on which device took which chunk
+
+  result.reduced = HostBackend::ReduceIdentity(job.reduce);
+
+  for (uint32_t c = 0; REDUCE_NONE != job.reduce && c < n_chunks; c++)
+    result.reduced = HostBackend::ReduceCombine(job.reduce, result.reduced,
+      reduced.at(c));
+
+  return result;
+}
+
+//*********************************************************************
+//
+// Chunk Pipeline
+//
+//*********************************************************************
+
+//
+// Runs every chunk of one pass over the data set and returns the wall time.
+//
+// Every device pulls chunks from a shared queue, one per free slot, on its own
+// submission thread (DeviceWorker). When a slot's read completes its callback
+// reports it to the scheduler and the device gets the next unclaimed chunk, so
+// devices finish at about the same time regardless of their relative speed.
+//
+// Failed chunks are retried on whichever device claims them next. Devices in
+// quarantined sit the run out, and those quarantined during it are added.
+// completed is false if the run was given up.
+//
+double RunChunks(OclEnv * env, std::vector<uint32_t> & gpus,
+  std::vector< std::vector<BufferSlot> > * slots, Profiler * profiler,
+  HostBackend * host, const ChunkData & data, bool report,
+  std::vector<bool> * quarantined, bool * completed)
+{
+  // launch geometry of each device's kernel variant
+
+  std::vector<cl::NDRange> global_ranges(gpus.size());
+  std::vector<cl::NDRange> local_ranges(gpus.size());
+
+  for (uint32_t d = 0; d < gpus.size(); d++)
+    env->KernelRange(gpus.at(d), data.n_chunk, &global_ranges.at(d),
+      &local_ranges.at(d));
+
+  // the host backend, if used, is one more consumer of the chunk queue,
+  // after all the OpenCL devices
+
+  ChunkScheduler scheduler(data.n_chunks,
+    gpus.size() + (host != NULL ? 1 : 0), data.retries, data.quarantine);
+
+  for (uint32_t d = 0; d < gpus.size(); d++)
+  {
+    if (quarantined->at(d))
+      scheduler.Quarantine(d);
+  }
+
+  for (uint32_t d = 0; d < gpus.size(); d++)
+  {
+    for (uint32_t s = 0; s < slots->at(d).size(); s++)
+    {
+      BufferSlot * slot = &slots->at(d).at(s);
+      slot->busy = false;
+      slot->scheduler = &scheduler;
+      slot->device = d;
+      slot->index = s;
+    }
+  }
+
+  std::chrono::high_resolution_clock::time_point t_start =
+    std::chrono::high_resolution_clock::now();
+
+  for (uint32_t c = 0; c < data.prefetch; c++)
+    PrefetchChunk(data, c);
+
+  // one submission thread per device, so a driver call blocking on one
+  // device does not hold up enqueueing on the others
+
+  std::vector<std::thread> device_workers;
+  for (uint32_t d = 0; d < gpus.size(); d++)
+  {
+    if (!quarantined->at(d))
+      device_workers.push_back(std::thread(DeviceWorker, env, gpus.at(d), d,
+        &slots->at(d), profiler, &scheduler, &data, global_ranges.at(d),
+        local_ranges.at(d)));
+  }
+
+  std::thread host_worker;
+  if (host != NULL)
+    host_worker = std::thread(HostWorker, host, &scheduler, gpus.size(),
+      &data);
+
+  for (uint32_t d = 0; d < device_workers.size(); d++)
+    device_workers.at(d).join();
+
+  if (host_worker.joinable())
+    host_worker.join();
+
+  double elapsed = std::chrono::duration<double>(
+    std::chrono::high_resolution_clock::now() - t_start).count();
+
+  for (uint32_t d = 0; d < gpus.size(); d++)
+    quarantined->at(d) = scheduler.Quarantined(d);
+
+  *completed = !scheduler.Aborted();
+
+  if (report || !*completed)
+  {
+    std::vector<std::string> names;
+    for (uint32_t d = 0; d < gpus.size(); d++)
+      names.push_back("Device " + std::to_string(gpus.at(d)) +
+        (quarantined->at(d) ? " (quarantined)" : ""));
+    if (host != NULL)
+      names.push_back("Host (" + host->IsaString() + ", " +
+        std::to_string(host->HowManyThreads()) + " threads)");
+
+    scheduler.PrintStats(names);
+  }
+
+  return elapsed;
+}
+
+//
+// Submission thread of one OpenCL device (engine is its index in gpus and in
+// the scheduler). Hands a chunk to every free slot of the device, then sleeps
+// until one of them drains or a chunk is up for a retry, until the run is
+// over, or the device quarantined, and nothing is in flight any more.
+//
+// A chunk fails if enqueueing it does, if its commands end in an error, or if
+// its outputs can not be copied out. Whatever of it was enqueued is left to
+// run out (AbandonChunk) and it goes back to the scheduler. With
+// data->fault_rate, attempts fail on purpose, half of them at enqueue (nothing
+// is enqueued) and half once they have run (their outputs are discarded).
+//
+void DeviceWorker(OclEnv * env, uint32_t device, uint32_t engine,
+  std::vector<BufferSlot> * slots, Profiler * profiler,
+  ChunkScheduler * scheduler, const ChunkData * data,
+  cl::NDRange global_range, cl::NDRange local_range)
+{
+  cl_int err;
+
+  cl::Context * cntxt = env->GetContext(device);
+  cl::CommandQueue * h2d = env->GetCq(device, QUEUE_H2D);
+  cl::CommandQueue * cq = env->GetCq(device, QUEUE_COMPUTE);
+  cl::CommandQueue * d2h = env->GetCq(device, QUEUE_D2H);
+  cl::Kernel * kern = env->GetKernel(device);
+  cl::Kernel * gen = env->GetGenerateKernel(device);
+  cl::Kernel * red = REDUCE_NONE != data->reduce ?
+    env->GetReduceKernel(device) : NULL;
+
+  bool inject = data->fault_rate > 0 && (data->fault_device < 0 ||
+    static_cast<uint32_t>(data->fault_device) == device);
+  std::default_random_engine faults(data->seed + device);
+  std::uniform_real_distribution<double> roll(0.0, 1.0);
+
+  uint32_t in_flight = 0;
+  bool stopped = false; // quarantined
+  std::vector<SlotCompletion> drained;
+
+  while (true)
+  {
+    for (uint32_t s = 0; s < slots->size() && !stopped; s++)
+    {
+      BufferSlot * slot = &slots->at(s);
+      uint32_t c;
+
+      if (slot->busy)
+        continue;
+      if (!scheduler->Next(engine, &c))
+        break;
+
+      PrefetchChunk(*data, c + data->prefetch);
+
+      std::chrono::high_resolution_clock::time_point t_enqueue =
+        std::chrono::high_resolution_clock::now();
+
+      if (inject && roll(faults) < data->fault_rate / 2)
+        err = CL_OUT_OF_RESOURCES;
+      else
+        err = EnqueueChunk(cntxt, h2d, cq, d2h, kern, gen, red, slot, *data,
+          c, global_range, local_range);
+
+      if (CL_SUCCESS == err)
+        err = slot->read_events.back().setCallback(CL_COMPLETE, SlotDrained,
+          slot);
+
+      if (CL_SUCCESS != err)
+      {
+        AbandonChunk(h2d, cq, d2h, slot);
+        stopped = ChunkFailed(env, device, engine, scheduler, c, err,
+          stopped);
+        continue;
+      }
+
+      profiler->RecordSpan(engine, c, "enqueue", t_enqueue,
+        std::chrono::high_resolution_clock::now());
+      for (uint32_t w = 0; w < slot->write_events.size(); w++)
+        profiler->RecordEvent(engine, c,
+          data->generate ? STAGE_GENERATE : STAGE_WRITE,
+          slot->length * data->element, slot->write_events.at(w));
+      if (REDUCE_NONE != data->reduce && REDUCE_DOT != data->reduce)
+        profiler->RecordEvent(engine, c, STAGE_KERNEL, slot->bytes,
+          slot->op_event);
+      profiler->RecordEvent(engine, c, STAGE_KERNEL, slot->bytes,
+        slot->kernel_event.at(0));
+      for (uint32_t r = 0; r < slot->read_events.size(); r++)
+        profiler->RecordEvent(engine, c, STAGE_READ,
+          REDUCE_NONE == data->reduce ? slot->length * data->element :
+          slot->host_partials.size() * sizeof(float),
+          slot->read_events.at(r));
+
+      slot->busy = true;
+      in_flight++;
+    }
+
+    if (in_flight == 0 && (stopped || scheduler->Finished()))
+      break;
+
+    scheduler->WaitDone(engine, &drained);
+
+    for (uint32_t i = 0; i < drained.size(); i++)
+    {
+      // only a wake-up, the loop above claims the retry if there is one
+      if (drained.at(i).slot == NO_SLOT)
+        continue;
+
+      BufferSlot * slot = &slots->at(drained.at(i).slot);
+      cl_int status = drained.at(i).status;
+
+      if (status >= 0 && inject && roll(faults) < data->fault_rate / 2)
+        status = CL_OUT_OF_RESOURCES;
+
+      if (status >= 0)
+        status = FinishChunk(d2h, slot, *data);
+
+      slot->busy = false;
+      in_flight--;
+
+      if (status < 0)
+      {
+        AbandonChunk(h2d, cq, d2h, slot);
+        stopped = ChunkFailed(env, device, engine, scheduler, slot->chunk,
+          status, stopped);
+        continue;
+      }
+
+      ReleaseChunk(*data, slot->chunk);
+      scheduler->Completed(engine, slot->chunk);
+    }
+  }
+
+  // zero copy unmaps are still queued
+  cl::CommandQueue * queues[] = {h2d, cq, d2h};
+
+  for (uint32_t q = 0; q < 3; q++)
+  {
+    if (q > 0 && queues[q] == queues[q - 1])
+      continue;
+
+    err = queues[q]->finish();
+    if (CL_SUCCESS != err)
+      printf("Device %d: could not finish its queues (%s)\n", device,
+        env->OclErrorStrings(err).c_str());
+  }
+}
+
+//
+// Reports chunk c's failure on device to the scheduler. Returns whether the
+// device is quarantined, stopped is whether it was before.
+//
+bool ChunkFailed(OclEnv * env, uint32_t device, uint32_t engine,
+  ChunkScheduler * scheduler, uint32_t c, cl_int status, bool stopped)
+{
+  bool quarantined = scheduler->Failed(engine, c);
+
+  printf("Device %d: chunk %d failed (%s)%s\n", device, c,
+    env->OclErrorStrings(status).c_str(), scheduler->Aborted() ? "" :
+    ", queued for a retry");
+
+  if (quarantined && !stopped)
+    printf("Device %d quarantined, its chunks go to the other devices\n",
+      device);
+
+  return quarantined;
+}
+
+//
+// Host backend engine, runs on its own thread and claims chunks from the same
+// queue as the OpenCL devices until the run is over, retries included. It
+// never fails a chunk.
+//
+void HostWorker(HostBackend * host, ChunkScheduler * scheduler,
+  uint32_t engine, const ChunkData * data)
+{
+  uint32_t c;
+  uint64_t n_chunk = data->n_chunk; // the tail chunk uses the front of it
+  uint32_t n_in = data->op->n_inputs;
+  uint32_t n_out = data->op->n_outputs;
+
+  std::vector<HostArray> generated(data->generate ? n_in : 0,
+    HostArray(n_chunk));
+
+  // a reduced operation's outputs only live as long as the chunk
+  bool reduce_out = (REDUCE_NONE != data->reduce && REDUCE_DOT != data->reduce);
+  std::vector<HostArray> reduced(reduce_out ? n_out : 0, HostArray(n_chunk));
+
+  std::vector<const float *> in(n_in);
+  std::vector<float *> out(n_out);
+  std::vector<const void *> typed_in(n_in);
+  std::vector<void *> typed_out(n_out);
+  std::vector<SlotCompletion> wake;
+
+  while (true)
+  {
+    if (!scheduler->Next(engine, &c))
+    {
+      // the queue is empty, but a device may still hand a chunk back
+      if (scheduler->Finished())
+        break;
+
+      scheduler->WaitDone(engine, &wake);
+      continue;
+    }
+
+    PrefetchChunk(*data, c + data->prefetch);
+
+    uint64_t first = c * n_chunk;
+    uint64_t length = ChunkLength(*data, c);
+
+    // other element types only ever run over host arrays
+    if (TYPE_FLOAT != data->type)
+    {
+      for (uint32_t b = 0; b < n_in; b++)
+        typed_in.at(b) = ElementAt(*data, data->in.at(b), first);
+      for (uint32_t b = 0; b < n_out; b++)
+        typed_out.at(b) = ElementAt(*data, data->out.at(b), first);
+
+      host->Run(data->type, *data->op, typed_in.data(), typed_out.data(),
+        data->params.data(), length);
+
+      ReleaseChunk(*data, c);
+      scheduler->Processed(engine, (n_in + n_out) * length * data->size);
+      scheduler->Completed(engine, c);
+      continue;
+    }
+
+    for (uint32_t b = 0; b < n_in; b++)
+    {
+      if (data->generate)
+      {
+        host->Generate(generated.at(b).data(), first, length, b, data->seed);
+        in.at(b) = generated.at(b).data();
+      }
+      else
+      {
+        in.at(b) = static_cast<const float*>(data->in.at(b)) + first;
+      }
+    }
+
+    for (uint32_t b = 0; b < n_out; b++)
+      out.at(b) = reduce_out ? reduced.at(b).data() :
+        REDUCE_NONE == data->reduce ?
+        static_cast<float*>(data->out.at(b)) + first : NULL;
+
+    if (REDUCE_DOT == data->reduce)
+      data->reduced[c] = host->Reduce(REDUCE_DOT, in.at(0), in.at(1), length);
+    else
+      host->Run(*data->op, in.data(), out.data(), data->params.data(),
+        length);
+
+    if (reduce_out)
+      data->reduced[c] = host->Reduce(data->reduce, out.at(0), NULL, length);
+
+    ReleaseChunk(*data, c);
+    scheduler->Processed(engine, (n_in + (REDUCE_NONE == data->reduce ?
+      n_out : 0)) * length * sizeof(float));
+    scheduler->Completed(engine, c);
+  }
+}
+
+//
+// Allocates the device (and for pinned transfers, staging) buffers of a slot
+// according to slot->mode, one per input and output of the operation. Zero
+// copy slots wrap the host arrays directly, so their buffers are created per
+// chunk in EnqueueChunk instead. Reductions keep the outputs on the device
+// (none at all for REDUCE_DOT) and only read back slot->host_partials.
+// Device buffers come from pool, the pinned staging buffers are host memory
+// and are allocated directly.
+//
+cl_int CreateSlotBuffers(BufferPool * pool, cl::Context * cntxt,
+  cl::CommandQueue * cq, BufferSlot * slot, const ChunkData & data)
+{
+  cl_int err = CL_SUCCESS;
+
+  uint32_t n_in = data.op->n_inputs;
+  uint32_t n_out = REDUCE_DOT == data.reduce ? 0 : data.op->n_outputs;
+  bool reduce = (REDUCE_NONE != data.reduce);
+  bool share_staging = data.in_place && !data.generate;
+
+  slot->in.assign(n_in, cl::Buffer());
+  slot->out.assign(n_out, cl::Buffer());
+  slot->host_in.assign(n_in, NULL);
+  slot->host_out.assign(n_out, NULL);
+  slot->mapped_out.assign(n_out, NULL);
+  slot->dest.assign(n_out, NULL);
+
+  slot->in_place = data.in_place &&
+    !(TRANSFER_ZEROCOPY == slot->mode && data.generate);
+
+  // generated inputs are written by a kernel, and always live on the device,
+  // an input shared with an output is written by the operation
+  cl_mem_flags in_flags = data.generate ? CL_MEM_READ_WRITE : CL_MEM_READ_ONLY;
+
+  if (reduce)
+  {
+    err = pool->Acquire(slot->host_partials.size() * sizeof(float),
+      CL_MEM_WRITE_ONLY, &slot->partials);
+    if (CL_SUCCESS != err)
+      return err;
+  }
+
+  // zero copy inputs wrap the host arrays, see EnqueueChunk
+  bool wrap_in = (TRANSFER_ZEROCOPY == slot->mode && !data.generate);
+
+  for (uint32_t b = 0; !wrap_in && b < n_in; b++)
+  {
+    err = pool->Acquire(slot->size, slot->in_place && b == 0 ?
+      CL_MEM_READ_WRITE : in_flags, &slot->in.at(b));
+    if (CL_SUCCESS != err)
+      return err;
+  }
+
+  if (TRANSFER_ZEROCOPY == slot->mode && !reduce)
+    return err;
+
+  if (slot->in_place)
+    slot->out.at(0) = slot->in.at(0);
+
+  for (uint32_t b = slot->in_place ? 1 : 0; b < n_out; b++)
+  {
+    err = pool->Acquire(slot->size,
+      reduce ? CL_MEM_READ_WRITE : CL_MEM_WRITE_ONLY, &slot->out.at(b));
+    if (CL_SUCCESS != err)
+      return err;
+  }
+
+  if (TRANSFER_COPY == slot->mode &&
+    (WIRE_FP32 != data.wire || LAYOUT_SOA == data.layout))
+  {
+    // pageable staging for the converted elements
+    uint64_t words = (slot->size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    slot->stage_in.assign(data.generate ? 0 : n_in,
+      std::vector<uint64_t>(words));
+    slot->stage_out.assign(reduce ? 0 : n_out, std::vector<uint64_t>(words));
+
+    for (uint32_t b = 0; b < slot->stage_in.size(); b++)
+      slot->host_in.at(b) = slot->stage_in.at(b).data();
+    for (uint32_t b = 0; b < slot->stage_out.size(); b++)
+      slot->host_out.at(b) = slot->stage_out.at(b).data();
+
+    if (share_staging)
+    {
+      slot->stage_out.at(0).clear();
+      slot->host_out.at(0) = slot->host_in.at(0);
+    }
+  }
+
+  if (TRANSFER_PINNED != slot->mode)
+    return err;
+
+  // Page locked staging buffers, mapped once and kept mapped. Generated
+  // inputs never leave the device and need none.
+
+  slot->pin_in.assign(data.generate ? 0 : n_in, cl::Buffer());
+  slot->pin_out.assign(reduce ? 0 : n_out, cl::Buffer());
+
+  std::vector<cl::Buffer *> pins;
+  std::vector<void **> hosts;
+
+  for (uint32_t b = 0; b < slot->pin_in.size(); b++)
+  {
+    pins.push_back(&slot->pin_in.at(b));
+    hosts.push_back(&slot->host_in.at(b));
+  }
+  for (uint32_t b = share_staging ? 1 : 0; b < slot->pin_out.size(); b++)
+  {
+    pins.push_back(&slot->pin_out.at(b));
+    hosts.push_back(&slot->host_out.at(b));
+  }
+
+  for (uint32_t b = 0; b < pins.size(); b++)
+  {
+    *pins[b] = cl::Buffer((*cntxt),
+      CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, slot->size, NULL, &err);
+    if (CL_SUCCESS != err)
+      return err;
+
+    *hosts[b] = cq->enqueueMapBuffer(*pins[b], CL_TRUE,
+      CL_MAP_READ | CL_MAP_WRITE, 0, slot->size, NULL, NULL, &err);
+    if (CL_SUCCESS != err)
+      return err;
+  }
+
+  // the result is read back into the input's staging
+  if (share_staging)
+    slot->host_out.at(0) = slot->host_in.at(0);
+
+  return err;
+}
+
+//
+// Unmaps a slot's pinned staging buffers and returns its device buffers to
+// pool. Zero copy buffers over host memory are not the pool's and are just
+// dropped. Also takes slots CreateSlotBuffers failed on part way.
+//
+void ReleaseSlotBuffers(BufferPool * pool, cl::CommandQueue * cq,
+  BufferSlot * slot)
+{
+  for (uint32_t b = 0; b < slot->pin_in.size(); b++)
+  {
+    if (slot->host_in.at(b) != NULL)
+      cq->enqueueUnmapMemObject(slot->pin_in.at(b), slot->host_in.at(b));
+  }
+  for (uint32_t b = 0; b < slot->pin_out.size(); b++)
+  {
+    // in place, output 1 may share input 1's staging
+    if (slot->pin_out.at(b)() != NULL && slot->host_out.at(b) != NULL)
+      cq->enqueueUnmapMemObject(slot->pin_out.at(b), slot->host_out.at(b));
+  }
+
+  for (uint32_t b = 0; b < slot->in.size(); b++)
+    pool->Release(&slot->in.at(b));
+  for (uint32_t b = slot->in_place ? 1 : 0; b < slot->out.size(); b++)
+    pool->Release(&slot->out.at(b));
+
+  pool->Release(&slot->partials);
+}
+
+//
+// Enqueues the input writes, the kernel and the output reads for a single
+// chunk on slot.
+//
+// Per slot dependencies, where the "previous" commands are those of the
+// chunk that last used the same slot:
+//   writes wait on the previous kernel (it still reads the inputs)
+//   kernel waits on all writes and on the previous reads (it writes outputs)
+//   the first read waits on the kernel, every further one on the read before
+// Nothing else is ordered, so one chunk's writes, another's kernel and a
+// third's reads can be in flight at the same time.
+//
+// TRANSFER_COPY writes/reads straight from/to the (pageable) host arrays.
+// TRANSFER_PINNED copies the inputs into the slot's staging buffers first;
+// the outputs are copied out of staging by FinishChunk.
+// TRANSFER_ZEROCOPY wraps the chunk's host memory in CL_MEM_USE_HOST_PTR
+// buffers, skips the writes and maps the outputs instead of reading them.
+// With a 16 bit wire format the inputs are converted into the staging
+// buffers (TRANSFER_COPY has pageable ones for this) instead of copied, and
+// FinishChunk converts the outputs back. The SoA layout is the same, with a
+// transpose for the conversion.
+//
+// In place, the kernel writes its first output over its first input. The
+// next chunk's write to that buffer can not overtake this chunk's read of it,
+// as a slot only gets a new chunk once it has drained.
+//
+// With a reduction, red reduces the first output (REDUCE_DOT: the first two
+// inputs, and kern is not run) to one partial per work-group after the kernel,
+// and only the partials are read back.
+//
+// The last chunk of a data set that is not a whole number of chunks is
+// shorter: only its elements are transferred, and the kernels, launched as
+// for a whole chunk, are passed its length and bounds check against it.
+//
+// Writes go to h2d, kernels (input generation included) to cq and reads and
+// maps to d2h. With -queues=single these are all the same queue; otherwise
+// the events above order the commands across the queues, and each queue is
+// flushed before a command on another queue waits on its events.
+//
+cl_int EnqueueChunk(cl::Context * cntxt, cl::CommandQueue * h2d,
+  cl::CommandQueue * cq, cl::CommandQueue * d2h, cl::Kernel * kern,
+  cl::Kernel * gen, cl::Kernel * red, BufferSlot * slot,
+  const ChunkData & data, uint32_t c, cl::NDRange global_range,
+  cl::NDRange local_range)
+{
+  cl_int err;
+
+  uint32_t n_in = data.op->n_inputs;
+  uint32_t n_out = data.op->n_outputs;
+
+  uint64_t first = static_cast<uint64_t>(c) * data.n_chunk;
+  uint32_t length = ChunkLength(data, c);
+  uint64_t bytes = static_cast<uint64_t>(length) * data.element;
+
+  for (uint32_t b = 0; b < data.out.size(); b++)
+    slot->dest.at(b) = ElementAt(data, data.out.at(b), first);
+  slot->chunk = c;
+  slot->length = length;
+  slot->bytes = (n_in + (REDUCE_NONE == data.reduce ? n_out : 0)) * bytes;
+
+  if (TRANSFER_ZEROCOPY == slot->mode)
+  {
+    if (!data.generate)
+    {
+      for (uint32_t b = 0; b < n_in; b++)
+      {
+        slot->in.at(b) = cl::Buffer((*cntxt), (slot->in_place && b == 0 ?
+          CL_MEM_READ_WRITE : CL_MEM_READ_ONLY) | CL_MEM_USE_HOST_PTR, bytes,
+          const_cast<void*>(ElementAt(data, data.in.at(b), first)), &err);
+        if (CL_SUCCESS != err)
+          return err;
+      }
+
+      slot->write_events.clear();
+
+      if (slot->in_place)
+        slot->out.at(0) = slot->in.at(0);
+    }
+
+    for (uint32_t b = slot->in_place ? 1 : 0; b < data.out.size(); b++)
+    {
+      slot->out.at(b) = cl::Buffer((*cntxt),
+        CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR, bytes, slot->dest.at(b),
+        &err);
+      if (CL_SUCCESS != err)
+        return err;
+    }
+  }
+
+  if (data.generate)
+  {
+    // Generate the inputs in place, one PhiloxUniform launch per stream
+
+    uint64_t blocks = (first + length + 3) / 4 - first / 4;
+
+    slot->write_events.resize(n_in);
+
+    for (uint32_t b = 0; b < n_in; b++)
+    {
+      gen->setArg(0, slot->in.at(b));
+      gen->setArg(1, static_cast<cl_ulong>(first));
+      gen->setArg(2, static_cast<cl_uint>(length));
+      gen->setArg(3, static_cast<cl_uint>(b));
+      gen->setArg(4, static_cast<cl_uint>(data.seed));
+      gen->setArg(5, static_cast<cl_uint>(data.seed >> 32));
+
+      err = cq->enqueueNDRangeKernel(
+        (*gen), // address of kernel
+        cl::NDRange(0), // starting global index
+        cl::NDRange(blocks), // one work-item per Philox block
+        cl::NullRange, // work items / work group
+        slot->used ? &slot->kernel_event : NULL, // previous kernel on slot
+        &slot->write_events.at(b) // output event info
+      );
+      if (CL_SUCCESS != err)
+        return err;
+    }
+  }
+  else if (TRANSFER_ZEROCOPY != slot->mode)
+  {
+    // Write to the input buffers
+
+    slot->write_events.resize(n_in);
+
+    for (uint32_t b = 0; b < n_in; b++)
+    {
+      const void * source = ElementAt(data, data.in.at(b), first);
+
+      if (WIRE_FP32 != data.wire)
+      {
+        data.host->Encode(data.wire, static_cast<const float*>(source),
+          static_cast<uint16_t*>(slot->host_in.at(b)), length);
+        source = slot->host_in.at(b);
+      }
+      else if (LAYOUT_SOA == data.layout)
+      {
+        data.host->ToSoA(data.type, data.components, source,
+          slot->host_in.at(b), length / data.components);
+        source = slot->host_in.at(b);
+      }
+      else if (TRANSFER_PINNED == slot->mode)
+      {
+        memcpy(slot->host_in.at(b), source, bytes);
+        source = slot->host_in.at(b);
+      }
+
+      err = h2d->enqueueWriteBuffer(
+        slot->in.at(b), // address of relevant cl::Buffer
+        CL_FALSE, // non blocking
+        static_cast<uint32_t>(0), // offset (bytes)
+        bytes, // total write size (bytes)
+        source, // pointer to root of data array
+        slot->used ? &slot->kernel_event : NULL, // previous kernel on slot
+        &slot->write_events.at(b) // output event info
+      );
+      if (CL_SUCCESS != err)
+        return err;
+    }
+  }
+
+  if (h2d != cq)
+  {
+    err = h2d->flush();
+    if (CL_SUCCESS != err)
+      return err;
+  }
+
+  // execute the kernel
+
+  std::vector<cl::Event> wait_list(slot->write_events);
+  if (slot->used)
+    wait_list.push_back(slot->read_events.back());
+
+  // arguments are captured at enqueue time, so rebinding them for every
+  // chunk does not disturb kernels already in flight on other slots
+  uint32_t arg = 0;
+
+  if (REDUCE_DOT != data.reduce)
+  {
+    for (uint32_t b = 0; b < n_in; b++)
+      kern->setArg(arg++, slot->in.at(b));
+    for (uint32_t b = 0; b < n_out; b++)
+      kern->setArg(arg++, slot->out.at(b));
+    kern->setArg(arg++, static_cast<cl_uint>(length));
+    for (uint32_t p = 0; p < data.params.size(); p++)
+      OclEnv::SetParamArg(kern, arg++, data.type, data.params.at(p));
+
+    err = cq->enqueueNDRangeKernel(
+      (*kern), // address of kernel
+      cl::NDRange(0), // starting global index
+      global_range, // work-items, see OclEnv::KernelRange()
+      local_range, // work items / work group
+      &wait_list, // wait on these to be valid to execute
+      REDUCE_NONE == data.reduce ? &slot->kernel_event.at(0) :
+        &slot->op_event // output event info
+    );
+    if (CL_SUCCESS != err)
+      return err;
+  }
+
+  if (REDUCE_NONE != data.reduce)
+  {
+    // reduce on the device, read back one float per work-group
+
+    if (REDUCE_DOT != data.reduce)
+      wait_list.assign(1, slot->op_event);
+
+    arg = 0;
+    red->setArg(arg++, REDUCE_DOT == data.reduce ? slot->in.at(0) :
+      slot->out.at(0));
+    if (REDUCE_DOT == data.reduce)
+      red->setArg(arg++, slot->in.at(1));
+    red->setArg(arg++, slot->partials);
+    red->setArg(arg++, static_cast<cl_uint>(length));
+    red->setArg(arg++, cl::Local(slot->reduce_local * sizeof(float)));
+
+    err = cq->enqueueNDRangeKernel(
+      (*red),
+      cl::NDRange(0),
+      cl::NDRange(slot->host_partials.size() * slot->reduce_local),
+      cl::NDRange(slot->reduce_local), // see OclEnv::ReduceRange()
+      &wait_list,
+      &slot->kernel_event.at(0)
+    );
+    if (CL_SUCCESS != err)
+      return err;
+
+    if (d2h != cq)
+    {
+      err = cq->flush();
+      if (CL_SUCCESS != err)
+        return err;
+    }
+
+    std::vector<cl::Event> after(1, slot->kernel_event.at(0));
+
+    err = d2h->enqueueReadBuffer(slot->partials, CL_FALSE, 0,
+      slot->host_partials.size() * sizeof(float), slot->host_partials.data(),
+      &after, &slot->read_events.at(0));
+    if (CL_SUCCESS != err)
+      return err;
+
+    slot->used = true;
+
+    return d2h->flush();
+  }
+
+  if (d2h != cq)
+  {
+    err = cq->flush();
+    if (CL_SUCCESS != err)
+      return err;
+  }
+
+  // read back the data
+
+  for (uint32_t b = 0; b < n_out; b++)
+  {
+    std::vector<cl::Event> after(1,
+      b == 0 ? slot->kernel_event.at(0) : slot->read_events.at(b - 1));
+
+    if (TRANSFER_ZEROCOPY == slot->mode)
+    {
+      // mapping makes the kernel's writes visible in the host array
+      slot->mapped_out.at(b) = d2h->enqueueMapBuffer(slot->out.at(b),
+        CL_FALSE, CL_MAP_READ, 0, bytes, &after, &slot->read_events.at(b),
+        &err);
+    }
+    else
+    {
+      err = d2h->enqueueReadBuffer(
+        slot->out.at(b), // address of relevant cl::Buffer
+        CL_FALSE, // execute and blocking
+        static_cast<uint32_t>(0), // offset (bytes)
+        bytes, // total read size (bytes)
+        slot->host_out.at(b) != NULL ? slot->host_out.at(b) :
+          slot->dest.at(b), // destination, or staging
+        &after, // wait until kernel (or previous read) finishes to execute
+        &slot->read_events.at(b) // slot is free again once the last completes
+      );
+    }
+    if (CL_SUCCESS != err)
+      return err;
+  }
+
+  slot->used = true;
+
+  return d2h->flush();
+}
+
+//
+// Host side completion of a drained slot: copies pinned outputs to their
+// final place, converting them from a 16 bit wire format or the SoA layout,
+// or releases the zero copy mappings on cq, the queue they were mapped on. A
+// reduction's partials are combined into the chunk's result.
+//
+cl_int FinishChunk(cl::CommandQueue * cq, BufferSlot * slot,
+  const ChunkData & data)
+{
+  cl_int err = CL_SUCCESS;
+
+  if (REDUCE_NONE != data.reduce)
+  {
+    double x = HostBackend::ReduceIdentity(data.reduce);
+
+    for (uint32_t p = 0; p < slot->host_partials.size(); p++)
+      x = HostBackend::ReduceCombine(data.reduce, x, slot->host_partials.at(p));
+
+    data.reduced[slot->chunk] = x;
+
+    return err;
+  }
+
+  for (uint32_t b = 0; b < slot->out.size(); b++)
+  {
+    if (WIRE_FP32 != data.wire)
+    {
+      data.host->Decode(data.wire,
+        static_cast<const uint16_t*>(slot->host_out.at(b)),
+        static_cast<float*>(slot->dest.at(b)), slot->length);
+    }
+    else if (LAYOUT_SOA == data.layout)
+    {
+      data.host->FromSoA(data.type, data.components, slot->host_out.at(b),
+        slot->dest.at(b), slot->length / data.components);
+    }
+    else if (TRANSFER_PINNED == slot->mode)
+    {
+      memcpy(slot->dest.at(b), slot->host_out.at(b),
+        static_cast<uint64_t>(slot->length) * data.size);
+    }
+    else if (TRANSFER_ZEROCOPY == slot->mode && slot->mapped_out.at(b) != NULL)
+    {
+      err = cq->enqueueUnmapMemObject(slot->out.at(b), slot->mapped_out.at(b));
+      slot->mapped_out.at(b) = NULL;
+      if (CL_SUCCESS != err)
+        return err;
+    }
+  }
+
+  return err;
+}
+
+//
+// After a chunk failed on slot: waits for whatever of it was enqueued to run
+// out, so a retry can not race it, unmaps zero copy outputs, and forgets the
+// slot's events, which its next commands would otherwise wait on and inherit
+// the failure from. The device's other slots are waited for as well.
+//
+void AbandonChunk(cl::CommandQueue * h2d, cl::CommandQueue * cq,
+  cl::CommandQueue * d2h, BufferSlot * slot)
+{
+  for (uint32_t b = 0; b < slot->mapped_out.size(); b++)
+  {
+    if (slot->mapped_out.at(b) != NULL)
+      d2h->enqueueUnmapMemObject(slot->out.at(b), slot->mapped_out.at(b));
+    slot->mapped_out.at(b) = NULL;
+  }
+
+  // errors here are the device's failure itself, which is already known
+  h2d->finish();
+  cq->finish();
+  d2h->finish();
+
+  slot->used = false;
+}
+
+//
+// Read event callback, runs on an OpenCL driver thread.
+//
+void CL_CALLBACK SlotDrained(cl_event event, cl_int status, void * user_data)
+{
+  BufferSlot * slot = static_cast<BufferSlot*>(user_data);
+
+  slot->scheduler->Done(slot->device, slot->index, slot->bytes, status);
+}
+
+//
+// Elements in chunk c: n_chunk, except in a last chunk that holds whatever is
+// left over.
+//
+uint32_t ChunkLength(const ChunkData & data, uint32_t c)
+{
+  uint64_t first = static_cast<uint64_t>(c) * data.n_chunk;
+
+  return static_cast<uint32_t>(std::min<uint64_t>(data.n_chunk,
+    data.n - first));
+}
+
+//
+// Bytes per element in the device buffers and on the bus: the wire format's,
+// else the element type's.
+//
+uint32_t DeviceElementSize(const StreamJob & job)
+{
+  return WIRE_FP32 != job.wire ? HostBackend::WireSize(job.wire) :
+    GetElementInfo(job.type).size;
+}
+
+//
+// Element-sized buffers per slot: the inputs and the outputs, none of them
+// for a dot product reduction, and output 1 aliasing input 1 in place.
+//
+uint32_t DeviceBuffers(const StreamJob & job)
+{
+  return job.op->n_inputs + (REDUCE_DOT == job.reduce ? 0 :
+    job.op->n_outputs) - (job.in_place ? 1 : 0);
+}
+
+//
+// Operands crossing the bus per element: every input written, unless the
+// devices generate them, and every output read, unless reduced on device to
+// a few partials per chunk.
+//
+uint32_t MovedOperands(const StreamJob & job)
+{
+  return (job.generate ? 0 : job.op->n_inputs) +
+    (REDUCE_NONE == job.reduce ? job.op->n_outputs : 0);
+}
+
+//
+// Element i of one of data's arrays
+//
+const void * ElementAt(const ChunkData & data, const void * array,
+  uint64_t i)
+{
+  return static_cast<const char*>(array) + i * data.size;
+}
+
+void * ElementAt(const ChunkData & data, void * array, uint64_t i)
+{
+  return static_cast<char*>(array) + i * data.size;
+}
+
+//
+// Streamed files only: asks for chunk c's inputs to be read in ahead of use,
+// and drops a completed chunk's inputs and (once written back) output pages.
+//
+void PrefetchChunk(const ChunkData & data, uint32_t c)
+{
+  if (c >= data.n_chunks)
+    return;
+
+  uint64_t offset = static_cast<uint64_t>(c) * data.n_chunk * data.size;
+  uint64_t bytes = static_cast<uint64_t>(ChunkLength(data, c)) * data.size;
+
+  for (uint32_t b = 0; b < data.map_in.size(); b++)
+  {
+    if (data.map_in.at(b) != NULL)
+      data.map_in.at(b)->Prefetch(offset, bytes);
+  }
+}
+
+void ReleaseChunk(const ChunkData & data, uint32_t c)
+{
+  uint64_t offset = static_cast<uint64_t>(c) * data.n_chunk * data.size;
+  uint64_t bytes = static_cast<uint64_t>(ChunkLength(data, c)) * data.size;
+
+  for (uint32_t b = 0; b < data.map_in.size(); b++)
+  {
+    if (data.map_in.at(b) != NULL)
+      data.map_in.at(b)->Release(offset, bytes);
+  }
+  for (uint32_t b = 0; b < data.map_out.size(); b++)
+  {
+    if (data.map_out.at(b) != NULL)
+      data.map_out.at(b)->Release(offset, bytes);
+  }
+}
+
+//EOF
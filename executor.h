@@ -0,0 +1,191 @@
+/*
+# executor.h
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef  OCLPTX_EXECUTOR_H_
+#define  OCLPTX_EXECUTOR_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <CL/cl.hpp>
+
+#include "chunksizer.h"
+#include "customtypes.h"
+#include "hostbackend.h"
+#include "kernelregistry.h"
+#include "mappedfile.h"
+#include "oclenv.h"
+
+//
+// The chunk pipeline as a library. A StreamingExecutor initialises OpenCL
+// once (platforms, devices, contexts, queues, the buffer pools) and then runs
+// submitted jobs one after the other on a dispatcher thread, keeping the
+// built kernels, their tuning and the device buffers from one job to the
+// next. A job completes when the OpenCL completion callbacks
+// (clSetEventCallback) of its last chunks have fired; Submit() returns a
+// future for its result, or calls back with it.
+//
+// Executor wide settings come from ConfigData: device selection, kernel
+// cache, pipeline depth, transfer mode, host engine, autotuning,
+// warmup/repeat runs, profiling and failover (chunk retries, device
+// quarantine, injected faults). Everything about the data is per job.
+// A job without a chunk size, or an executor without a pipeline depth, gets
+// them from the devices' probed bandwidth and latency (ChunkSizer). A job can
+// move its data as fp16 or bf16 instead of float, converted on the host
+// (HostBackend::Encode/Decode) on the way to and from the devices. Sums
+// also run over double, int and long arrays, with a kernel built for the type,
+// and over vectors of them, optionally transposed to one array per component
+// on the devices.
+//
+
+struct StreamJob
+{
+  const KernelSignature * op; // must outlive the job
+  std::vector<double> params; // all of op's scalar parameters
+
+  uint64_t n; // elements per array, need not be a multiple of n_chunk
+  uint32_t n_chunk; // elements per chunk, the last chunk takes the remainder;
+                    // 0: chosen by the executor, see ChunkSizer
+
+  // ElementType of the arrays' elements, a component type: vector types are
+  // passed as arrays of their components. Anything but TYPE_FLOAT needs a
+  // registry op, inputs from the host, no reduction, no wire format and no
+  // in place output.
+  uint32_t type;
+
+  // Components per element of a vector type, 1 otherwise; every chunk then
+  // holds whole elements. Their Layout in the device buffers, the host
+  // arrays are interleaved either way.
+  uint32_t components;
+  uint32_t layout;
+
+  std::vector<const void *> in; // op->n_inputs arrays, empty if generate
+  std::vector<void *> out; // op->n_outputs arrays, empty if reduce
+
+  bool generate; // inputs are Philox streams made on the devices
+  uint64_t seed;
+
+  uint32_t reduce; // ReduceKind
+
+  // WireFormat of the device buffers and transfers. The 16 bit formats need
+  // an op with Half and Bf16 variants (sum), host inputs and no reduction.
+  uint32_t wire;
+
+  // The first output overwrites the first input: the devices use one buffer
+  // for both, and out[0] must be in[0] unless the inputs are generated. Every
+  // pass over host inputs then works on the previous pass's results. Not
+  // with a reduction.
+  bool in_place;
+
+  // the files behind in and out if they are memory mapped, else empty
+  std::vector<MappedFile *> map_in;
+  std::vector<MappedFile *> map_out;
+};
+
+struct JobResult
+{
+  std::vector<double> run_times; // seconds, of the timed (non warmup) runs
+  double moved; // bytes to and from the devices per run
+  double reduced; // the reduction, if the job had one
+  uint32_t n_chunk; // the chunk size used
+  uint32_t depth; // the buffer sets per device used
+
+  // false if a run was given up: a chunk failed on more than config.retries
+  // attempts, or every device was quarantined. run_times then only holds the
+  // runs before it.
+  bool completed;
+};
+
+class StreamingExecutor{
+
+  public:
+
+    StreamingExecutor(const ConfigData & config);
+
+    // finishes every job already submitted
+    ~StreamingExecutor();
+
+    std::future<JobResult> Submit(const StreamJob & job);
+
+    // done runs on the dispatcher thread
+    void Submit(const StreamJob & job,
+      std::function<void(const JobResult &)> done);
+
+    std::vector<uint32_t> GetGPUs();
+
+    HostBackend * GetHost();
+
+  private:
+
+    struct QueuedJob
+    {
+      StreamJob job;
+      std::promise<JobResult> promise;
+      std::function<void(const JobResult &)> done;
+    };
+
+    void Dispatch();
+
+    // builds (or keeps) the job's kernels, sizes its chunks and buffer sets
+    // if needed and tunes or loads the kernel variants
+    void Prepare(StreamJob * job, uint32_t * depth);
+
+    // fills in job->n_chunk and *depth where they are 0
+    void SizeChunks(StreamJob * job, uint32_t * depth);
+
+    JobResult Execute(const StreamJob & job);
+
+    ConfigData config;
+
+    OclEnv env;
+
+    std::vector<uint32_t> gpus;
+
+    HostBackend host;
+
+    std::string kernel_key; // op the built kernels are for
+    KernelSignature wire_op; // a job's op with its wire format's entry
+    uint32_t reduce_kernel; // ReduceKind the reduction kernels are for
+    std::vector<std::string> tuned; // ops autotuned at their chunk size
+    std::vector<DeviceProbe> probes; // per device, empty until first needed
+
+    // per device, whether it was taken out after failing chunks (see
+    // ChunkScheduler) or creating its buffers; it stays out for the rest of
+    // the job's runs, every job starts with all devices back in
+    std::vector<bool> quarantined;
+
+    std::deque<QueuedJob *> queue;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    bool stopping;
+
+    std::thread dispatcher;
+};
+
+#endif
+
+//EOF
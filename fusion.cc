@@ -0,0 +1,547 @@
+/*
+# fusion.cc
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include "fusion.h"
+#include "oclenv.h"
+
+// elements per step of the host evaluation, small enough that every node's
+// temporaries stay in cache
+static const uint64_t host_block = 512;
+
+//*********************************************************************
+//
+// FusedKernel Constructors/Destructors
+//
+//*********************************************************************
+//
+// Constructor(s)
+//
+FusedKernel::FusedKernel(){}
+
+//
+// Destructor
+//
+FusedKernel::~FusedKernel(){}
+
+//*********************************************************************
+//
+// FusedKernel Graph Construction
+//
+//*********************************************************************
+
+uint32_t FusedKernel::AddNode(const Node & node,
+  const std::vector<float> & params)
+{
+  for (uint32_t k = 0; k < this->nodes.size(); k++)
+  {
+    const Node & other = this->nodes.at(k);
+
+    if (other.op != node.op || other.operands != node.operands ||
+      other.input != node.input)
+      continue;
+
+    // inputs have no parameters, ops and constants need equal values
+    bool same = true;
+    for (uint32_t p = 0; same && p < params.size(); p++)
+      same = (memcmp(&this->param_values.at(other.first_param + p),
+        &params.at(p), sizeof(float)) == 0);
+
+    if (same)
+      return k;
+  }
+
+  Node added = node;
+  added.first_param = this->param_values.size();
+  this->param_values.insert(this->param_values.end(), params.begin(),
+    params.end());
+  this->nodes.push_back(added);
+
+  return this->nodes.size() - 1;
+}
+
+uint32_t FusedKernel::Input(uint32_t k)
+{
+  Node node = {NULL, std::vector<uint32_t>(), k, 0};
+
+  return this->AddNode(node, std::vector<float>());
+}
+
+uint32_t FusedKernel::Constant(float value)
+{
+  Node node = {NULL, std::vector<uint32_t>(), UINT32_MAX, 0};
+
+  return this->AddNode(node, std::vector<float>(1, value));
+}
+
+//
+// op must be a single output registry entry with an expression. Missing
+// trailing params take op's defaults.
+//
+uint32_t FusedKernel::Apply(const KernelSignature & op,
+  std::vector<uint32_t> operands, std::vector<float> params)
+{
+  if (op.n_outputs != 1 || op.expression.empty() ||
+    operands.size() != op.n_inputs ||
+    params.size() > op.param_defaults.size())
+  {
+    printf("%s can not be fused with %lu operands and %lu parameters.\n",
+      op.name.c_str(), operands.size(), params.size());
+    exit(EXIT_FAILURE);
+  }
+
+  for (uint32_t p = params.size(); p < op.param_defaults.size(); p++)
+    params.push_back(op.param_defaults.at(p));
+
+  Node node = {&op, operands, UINT32_MAX, 0};
+
+  return this->AddNode(node, params);
+}
+
+void FusedKernel::Output(uint32_t node)
+{
+  this->outputs.push_back(node);
+}
+
+//*********************************************************************
+//
+// FusedKernel Parsing
+//
+//*********************************************************************
+
+bool FusedKernel::Parse(std::string expressions)
+{
+  std::stringstream list(expressions);
+  std::string expression;
+
+  while (std::getline(list, expression, ';'))
+  {
+    size_t pos = 0;
+    uint32_t node;
+
+    if (expression.find_first_not_of(" \t") == std::string::npos)
+      continue;
+
+    if (!this->ParseExpression(expression, &pos, &node))
+      return false;
+
+    pos = expression.find_first_not_of(" \t", pos);
+    if (pos != std::string::npos)
+    {
+      printf("Unexpected \"%s\" after %s\n", expression.substr(pos).c_str(),
+        expression.substr(0, pos).c_str());
+      return false;
+    }
+
+    this->Output(node);
+  }
+
+  if (this->outputs.empty())
+  {
+    puts("Empty expression.");
+    return false;
+  }
+
+  return true;
+}
+
+//
+// expression := number | in<k> (k from 1)
+//   | op '(' expression, ... [, number ...] ')'
+//
+bool FusedKernel::ParseExpression(const std::string & text, size_t * pos,
+  uint32_t * node)
+{
+  *pos = text.find_first_not_of(" \t", *pos);
+  if (*pos == std::string::npos)
+  {
+    printf("Expression ends early: %s\n", text.c_str());
+    return false;
+  }
+
+  const char * start = text.c_str() + *pos;
+  char * end;
+  float value = strtof(start, &end);
+
+  if (end != start)
+  {
+    *pos += end - start;
+    *node = this->Constant(value);
+    return true;
+  }
+
+  size_t name_end = *pos;
+  while (name_end < text.length() &&
+    (isalnum(text[name_end]) || text[name_end] == '_'))
+    name_end++;
+
+  std::string name = text.substr(*pos, name_end - *pos);
+  *pos = name_end;
+
+  if (name.length() > 2 && name.compare(0, 2, "in") == 0 &&
+    name.find_first_not_of("0123456789", 2) == std::string::npos)
+  {
+    uint32_t k = std::stoul(name.substr(2));
+    if (k == 0)
+    {
+      puts("Inputs are numbered from in1.");
+      return false;
+    }
+    *node = this->Input(k - 1);
+    return true;
+  }
+
+  const KernelSignature * op = KernelRegistry::Find(name);
+  if (op == NULL || op->expression.empty() || op->n_outputs != 1)
+  {
+    printf("\"%s\" is not an input, a number or a fusable operation.\n",
+      name.c_str());
+    return false;
+  }
+
+  *pos = text.find_first_not_of(" \t", *pos);
+  if (*pos == std::string::npos || text[*pos] != '(')
+  {
+    printf("Expected ( after %s\n", name.c_str());
+    return false;
+  }
+  (*pos)++;
+
+  std::vector<uint32_t> operands;
+  std::vector<float> params;
+
+  for (uint32_t a = 0; ; a++)
+  {
+    *pos = text.find_first_not_of(" \t", *pos);
+    if (*pos == std::string::npos)
+      break;
+
+    if (text[*pos] == ')' && a >= op->n_inputs)
+      break;
+
+    if (a > 0)
+    {
+      if (text[*pos] != ',')
+        break;
+      *pos = text.find_first_not_of(" \t", *pos + 1);
+      if (*pos == std::string::npos)
+        break;
+    }
+
+    if (a < op->n_inputs)
+    {
+      uint32_t operand;
+      if (!this->ParseExpression(text, pos, &operand))
+        return false;
+      operands.push_back(operand);
+    }
+    else
+    {
+      start = text.c_str() + *pos;
+      value = strtof(start, &end);
+      if (end == start || params.size() == op->param_names.size())
+        break;
+      *pos += end - start;
+      params.push_back(value);
+    }
+  }
+
+  if (*pos == std::string::npos || text[*pos] != ')' ||
+    operands.size() != op->n_inputs)
+  {
+    printf("%s takes %d operands, then up to %lu numbers: %s\n",
+      name.c_str(), op->n_inputs, op->param_names.size(), text.c_str());
+    return false;
+  }
+  (*pos)++;
+
+  *node = this->Apply(*op, operands, params);
+
+  return true;
+}
+
+//*********************************************************************
+//
+// FusedKernel Signature
+//
+//*********************************************************************
+
+const KernelSignature & FusedKernel::Signature()
+{
+  uint32_t n_inputs = 0;
+
+  for (uint32_t k = 0; k < this->nodes.size(); k++)
+  {
+    if (this->nodes.at(k).op == NULL &&
+      this->nodes.at(k).input != UINT32_MAX)
+      n_inputs = std::max(n_inputs, this->nodes.at(k).input + 1);
+  }
+
+  // the entry point is named after the generated code, so each graph gets
+  // its own autotuning entry
+  char entry[32];
+  snprintf(entry, sizeof(entry), "Fused%016llx",
+    static_cast<unsigned long long>(OclEnv::HashFNV1a(this->Generate(""))));
+
+  this->signature.name = "fused";
+  this->signature.file = "elementwise.cl";
+  this->signature.entry = entry;
+  this->signature.formula = this->Describe();
+  this->signature.expression = "";
+  this->signature.n_inputs = n_inputs;
+  this->signature.n_outputs = this->outputs.size();
+  this->signature.param_names.clear();
+  for (uint32_t p = 0; p < this->param_values.size(); p++)
+    this->signature.param_names.push_back("p" + std::to_string(p));
+  this->signature.param_defaults.assign(this->param_values.begin(),
+    this->param_values.end());
+  this->signature.host = [this](const float * const * in, float * const * out,
+    const float * params, uint64_t begin, uint64_t end)
+    {
+      this->HostEvaluate(in, out, params, begin, end);
+    };
+  this->signature.generated = this->Generate(entry);
+
+  return this->signature;
+}
+
+uint32_t FusedKernel::HowManyOps()
+{
+  uint32_t ops = 0;
+
+  for (uint32_t k = 0; k < this->nodes.size(); k++)
+    ops += (this->nodes.at(k).op != NULL);
+
+  return ops;
+}
+
+std::string FusedKernel::Describe()
+{
+  std::string description;
+
+  for (uint32_t o = 0; o < this->outputs.size(); o++)
+    description += (o ? "; " : "") + this->NodeString(this->outputs.at(o));
+
+  return description;
+}
+
+std::string FusedKernel::NodeString(uint32_t k)
+{
+  const Node & node = this->nodes.at(k);
+  char value[32];
+
+  if (node.op == NULL && node.input != UINT32_MAX)
+    return "in" + std::to_string(node.input + 1);
+
+  if (node.op == NULL)
+  {
+    snprintf(value, sizeof(value), "%g",
+      this->param_values.at(node.first_param));
+    return value;
+  }
+
+  std::string call = node.op->name + "(";
+
+  for (uint32_t a = 0; a < node.operands.size(); a++)
+    call += (a ? ", " : "") + this->NodeString(node.operands.at(a));
+
+  for (uint32_t p = 0; p < node.op->param_names.size(); p++)
+  {
+    snprintf(value, sizeof(value), ", %g",
+      this->param_values.at(node.first_param + p));
+    call += value;
+  }
+
+  return call + ")";
+}
+
+//*********************************************************************
+//
+// FusedKernel Code Generation
+//
+//*********************************************************************
+//
+// One kernel in the style of kernels/elementwise.cl: the graph is evaluated
+// once per vector (FOR_VECTORS) and once per tail element (TAIL_ELEMENT),
+// every node a local variable x<k>, so each input is loaded and each output
+// stored exactly once.
+//
+std::string FusedKernel::Generate(const std::string & entry)
+{
+  std::ostringstream src;
+  uint32_t n_inputs = 0;
+
+  for (uint32_t k = 0; k < this->nodes.size(); k++)
+  {
+    if (this->nodes.at(k).op == NULL &&
+      this->nodes.at(k).input != UINT32_MAX)
+      n_inputs = std::max(n_inputs, this->nodes.at(k).input + 1);
+  }
+
+  src << "\n// generated by FusedKernel: " << this->Describe() << "\n\n";
+  src << "__kernel void " << entry << "(\n";
+
+  for (uint32_t i = 0; i < n_inputs; i++)
+    src << "  __global const float *in" << i << ",\n";
+  for (uint32_t o = 0; o < this->outputs.size(); o++)
+    src << "  __global float *out" << o << ",\n";
+  src << "  const uint n";
+  for (uint32_t p = 0; p < this->param_values.size(); p++)
+    src << ",\n  const float p" << p;
+  src << "\n)\n{\n";
+
+  src << "  FOR_VECTORS(v, n)\n  {\n" << this->Statements(true) << "  }\n\n";
+  src << "  TAIL_ELEMENT(t, n)\n  {\n" << this->Statements(false) << "  }\n";
+  src << "}\n";
+
+  return src.str();
+}
+
+std::string FusedKernel::Statements(bool vector)
+{
+  std::ostringstream body;
+  const char * type = vector ? "VTYPE" : "float";
+
+  for (uint32_t k = 0; k < this->nodes.size(); k++)
+  {
+    const Node & node = this->nodes.at(k);
+
+    body << "    " << type << " x" << k << " = ";
+
+    if (node.op == NULL && node.input != UINT32_MAX)
+    {
+      if (vector)
+        body << "VLOAD(v, in" << node.input << ");\n";
+      else
+        body << "in" << node.input << "[t];\n";
+      continue;
+    }
+
+    if (node.op == NULL)
+    {
+      body << "(" << type << ")(p" << node.first_param << ");\n";
+      continue;
+    }
+
+    // $k -> operand k's variable, $pk -> the kernel parameter holding
+    // parameter k of this node
+    const std::string & expression = node.op->expression;
+
+    for (size_t c = 0; c < expression.length(); c++)
+    {
+      if (expression[c] != '$')
+      {
+        body << expression[c];
+        continue;
+      }
+
+      bool param = (c + 1 < expression.length() && expression[c + 1] == 'p');
+      size_t digits = c + 1 + (param ? 1 : 0);
+      size_t digits_end = expression.find_first_not_of("0123456789", digits);
+      if (digits_end == std::string::npos)
+        digits_end = expression.length();
+
+      uint32_t index = std::stoul(expression.substr(digits,
+        digits_end - digits));
+
+      if (param)
+        body << "p" << node.first_param + index;
+      else
+        body << "x" << node.operands.at(index);
+
+      c = digits_end - 1;
+    }
+
+    body << ";\n";
+  }
+
+  for (uint32_t o = 0; o < this->outputs.size(); o++)
+  {
+    if (vector)
+      body << "    VSTORE(x" << this->outputs.at(o) << ", v, out" << o <<
+        ");\n";
+    else
+      body << "    out" << o << "[t] = x" << this->outputs.at(o) << ";\n";
+  }
+
+  return body.str();
+}
+
+//*********************************************************************
+//
+// FusedKernel Host Reference
+//
+//*********************************************************************
+//
+// Walks the graph a block of elements at a time with every operation's own
+// host reference, in the same order and precision as the generated kernel.
+//
+void FusedKernel::HostEvaluate(const float * const * in, float * const * out,
+  const float * params, uint64_t begin, uint64_t end)
+{
+  std::vector<float> temp(this->nodes.size() * host_block);
+  std::vector<const float *> values(this->nodes.size());
+  std::vector<const float *> operands;
+
+  for (uint64_t b = begin; b < end; b += host_block)
+  {
+    uint64_t length = std::min(host_block, end - b);
+
+    for (uint32_t k = 0; k < this->nodes.size(); k++)
+    {
+      const Node & node = this->nodes.at(k);
+      float * result = temp.data() + k * host_block;
+
+      if (node.op == NULL && node.input != UINT32_MAX)
+      {
+        values.at(k) = in[node.input] + b;
+        continue;
+      }
+
+      if (node.op == NULL)
+      {
+        std::fill(result, result + length, params[node.first_param]);
+      }
+      else
+      {
+        operands.clear();
+        for (uint32_t a = 0; a < node.operands.size(); a++)
+          operands.push_back(values.at(node.operands.at(a)));
+
+        node.op->host(operands.data(), &result, params + node.first_param, 0,
+          length);
+      }
+
+      values.at(k) = result;
+    }
+
+    for (uint32_t o = 0; o < this->outputs.size(); o++)
+      std::copy(values.at(this->outputs.at(o)),
+        values.at(this->outputs.at(o)) + length, out[o] + b);
+  }
+}
+
+//EOF
@@ -0,0 +1,123 @@
+/*
+# fusion.h
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef  OCLPTX_FUSION_H_
+#define  OCLPTX_FUSION_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "kernelregistry.h"
+
+//
+// Fuses a graph of registered element-wise operations into a single kernel,
+// so a chain like clamp(scale(sum(in0, in1))) uploads its inputs and
+// downloads its results once per chunk instead of once per operation.
+//
+// The graph is built with Input/Constant/Apply/Output, or parsed from text
+// such as
+//
+//   clamp(scale(sum(in1, in2), 0.5), 0.1, 0.9); sum(in1, 1)
+//
+// (one ';' separated expression per output, in1, in2, ... numbered like the
+// -in1=, -in2= files, operands first, then any of the
+// operation's parameters, defaults for those left out). Signature() then
+// describes the fused kernel like a registry entry: its generated source is
+// built and cached by OclEnv, its host reference evaluates the same graph
+// with the registry's host references, so results match bit for bit.
+//
+// Every operation parameter and constant becomes a kernel parameter (p0,
+// p1, ...), so changing values reuses the compiled kernel.
+//
+
+class FusedKernel{
+
+  public:
+
+    FusedKernel();
+
+    ~FusedKernel();
+
+    //
+    // Graph construction, each returns the new node (identical nodes are
+    // shared)
+    //
+
+    uint32_t Input(uint32_t k); // k from 0
+
+    uint32_t Constant(float value);
+
+    uint32_t Apply(const KernelSignature & op,
+      std::vector<uint32_t> operands, std::vector<float> params);
+
+    void Output(uint32_t node);
+
+    // Parses expressions into the graph. Prints what is wrong and returns
+    // false on errors.
+    bool Parse(std::string expressions);
+
+    //
+    // The fused kernel, valid until the graph is changed
+    //
+
+    const KernelSignature & Signature();
+
+    uint32_t HowManyOps();
+
+    std::string Describe();
+
+  private:
+
+    struct Node
+    {
+      const KernelSignature * op; // NULL for inputs and constants
+      std::vector<uint32_t> operands;
+      uint32_t input; // inputs: which one
+      uint32_t first_param; // ops: params[first_param, ...), constants: value
+    };
+
+    // appends node and params, unless an identical node already exists
+    uint32_t AddNode(const Node & node, const std::vector<float> & params);
+
+    std::string NodeString(uint32_t k);
+
+    bool ParseExpression(const std::string & text, size_t * pos,
+      uint32_t * node);
+
+    std::string Generate(const std::string & entry);
+
+    std::string Statements(bool vector);
+
+    void HostEvaluate(const float * const * in, float * const * out,
+      const float * params, uint64_t begin, uint64_t end);
+
+    std::vector<Node> nodes;
+
+    std::vector<uint32_t> outputs;
+
+    std::vector<float> param_values;
+
+    KernelSignature signature;
+};
+
+#endif
+
+//EOF
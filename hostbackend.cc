@@ -0,0 +1,1055 @@
+/*
+# hostbackend.cc
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include <immintrin.h>
+
+#include "customtypes.h"
+#include "hostbackend.h"
+#include "philox.h"
+
+//*********************************************************************
+//
+// SIMD Kernels
+//
+//*********************************************************************
+//
+// Each kernel handles [begin, end). The target attributes let this file be
+// compiled without -mavx2/-mavx512f; the caller only picks a kernel the CPU
+// actually supports.
+//
+
+static void SumScalar(const float * one, const float * two, float * out,
+  uint64_t begin, uint64_t end)
+{
+  for (uint64_t i = begin; i < end; i++)
+    out[i] = one[i] + two[i];
+}
+
+__attribute__((target("avx2")))
+static void SumAvx2(const float * one, const float * two, float * out,
+  uint64_t begin, uint64_t end)
+{
+  uint64_t i = begin;
+
+  for (; i + 8 <= end; i += 8)
+    _mm256_storeu_ps(out + i,
+      _mm256_add_ps(_mm256_loadu_ps(one + i), _mm256_loadu_ps(two + i)));
+
+  SumScalar(one, two, out, i, end);
+}
+
+__attribute__((target("avx512f")))
+static void SumAvx512(const float * one, const float * two, float * out,
+  uint64_t begin, uint64_t end)
+{
+  uint64_t i = begin;
+
+  for (; i + 16 <= end; i += 16)
+    _mm512_storeu_ps(out + i,
+      _mm512_add_ps(_mm512_loadu_ps(one + i), _mm512_loadu_ps(two + i)));
+
+  // masked tail instead of a scalar loop
+  if (i < end)
+  {
+    __mmask16 tail = static_cast<__mmask16>((1u << (end - i)) - 1);
+    _mm512_mask_storeu_ps(out + i, tail, _mm512_add_ps(
+      _mm512_maskz_loadu_ps(tail, one + i),
+      _mm512_maskz_loadu_ps(tail, two + i)));
+  }
+}
+
+//
+// Verification compares bit patterns of the recomputed sum, so it is exact
+// (a + b is correctly rounded on both the host and any OpenCL device).
+// Returns the number of mismatches and stores the first one in first_bad.
+//
+
+static uint64_t VerifyScalar(const float * one, const float * two,
+  const float * out, uint64_t begin, uint64_t end, uint64_t * first_bad)
+{
+  uint64_t bad = 0;
+
+  for (uint64_t i = begin; i < end; i++)
+  {
+    float expected = one[i] + two[i];
+
+    if (expected != out[i])
+    {
+      if (bad == 0)
+        *first_bad = i;
+      bad++;
+    }
+  }
+
+  return bad;
+}
+
+__attribute__((target("avx2")))
+static uint64_t VerifyAvx2(const float * one, const float * two,
+  const float * out, uint64_t begin, uint64_t end, uint64_t * first_bad)
+{
+  uint64_t bad = 0;
+  uint64_t i = begin;
+
+  for (; i + 8 <= end; i += 8)
+  {
+    __m256 expected = _mm256_add_ps(_mm256_loadu_ps(one + i),
+      _mm256_loadu_ps(two + i));
+    int mask = _mm256_movemask_ps(
+      _mm256_cmp_ps(expected, _mm256_loadu_ps(out + i), _CMP_NEQ_UQ));
+
+    if (mask)
+    {
+      if (bad == 0)
+        *first_bad = i + __builtin_ctz(mask);
+      bad += __builtin_popcount(mask);
+    }
+  }
+
+  uint64_t tail_first = 0;
+  uint64_t tail_bad = VerifyScalar(one, two, out, i, end, &tail_first);
+  if (bad == 0 && tail_bad > 0)
+    *first_bad = tail_first;
+
+  return bad + tail_bad;
+}
+
+__attribute__((target("avx512f")))
+static uint64_t VerifyAvx512(const float * one, const float * two,
+  const float * out, uint64_t begin, uint64_t end, uint64_t * first_bad)
+{
+  uint64_t bad = 0;
+
+  for (uint64_t i = begin; i < end; i += 16)
+  {
+    __mmask16 lanes = (end - i >= 16) ? static_cast<__mmask16>(0xFFFF) :
+      static_cast<__mmask16>((1u << (end - i)) - 1);
+
+    __m512 expected = _mm512_add_ps(_mm512_maskz_loadu_ps(lanes, one + i),
+      _mm512_maskz_loadu_ps(lanes, two + i));
+    __mmask16 mask = _mm512_mask_cmp_ps_mask(lanes, expected,
+      _mm512_maskz_loadu_ps(lanes, out + i), _CMP_NEQ_UQ);
+
+    if (mask)
+    {
+      if (bad == 0)
+        *first_bad = i + __builtin_ctz(mask);
+      bad += __builtin_popcount(mask);
+    }
+  }
+
+  return bad;
+}
+
+template <typename T>
+static uint64_t CompareScalar(const T * expected, const T * actual,
+  uint64_t begin, uint64_t end, uint64_t * first_bad)
+{
+  uint64_t bad = 0;
+
+  for (uint64_t i = begin; i < end; i++)
+  {
+    if (expected[i] != actual[i])
+    {
+      if (bad == 0)
+        *first_bad = i;
+      bad++;
+    }
+  }
+
+  return bad;
+}
+
+static double ReduceScalar(uint32_t reduce, const float * one,
+  const float * two, uint64_t begin, uint64_t end)
+{
+  double x = HostBackend::ReduceIdentity(reduce);
+
+  for (uint64_t i = begin; i < end; i++)
+  {
+    if (REDUCE_DOT == reduce)
+      x += static_cast<double>(one[i]) * two[i];
+    else
+      x = HostBackend::ReduceCombine(reduce, x, one[i]);
+  }
+
+  return x;
+}
+
+//
+// 16 bit wire formats, both rounded to nearest even. The scalar fp16
+// conversion matches F16C's vcvtps2ph bit for bit: overflow goes to
+// infinity, small values to subnormals and NaNs keep their upper payload
+// bits, quiet. bf16 simply rounds off the lower half of the float.
+//
+
+static uint16_t FloatToHalf(float f)
+{
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+
+  uint16_t sign = (x >> 16) & 0x8000;
+  uint32_t abs = x & 0x7FFFFFFF;
+
+  if (abs > 0x7F800000) // NaN
+    return sign | 0x7E00 | ((abs >> 13) & 0x3FF);
+  if (abs >= 0x47800000) // 65536 or more, infinity
+    return sign | 0x7C00;
+
+  if (abs >= 0x38800000)
+  {
+    // normal half: rebias the exponent, round the mantissa (a carry into the
+    // exponent is correct, up to infinity)
+    uint32_t r = abs - 0x38000000;
+    r += 0xFFF + ((r >> 13) & 1);
+    return sign | (r >> 13);
+  }
+
+  if (abs <= 0x33000000) // 2^-25 or less rounds to zero
+    return sign;
+
+  // subnormal half: the value in units of 2^-24
+  uint32_t mantissa = (abs & 0x7FFFFF) | 0x800000;
+  uint32_t shift = 126 - (abs >> 23);
+  uint32_t q = mantissa >> shift;
+  uint32_t rest = mantissa & ((1u << shift) - 1);
+  uint32_t half = 1u << (shift - 1);
+
+  if (rest > half || (rest == half && (q & 1)))
+    q++;
+
+  return sign | q;
+}
+
+static float HalfToFloat(uint16_t h)
+{
+  uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1F;
+  uint32_t mantissa = h & 0x3FF;
+  uint32_t x;
+
+  if (exponent == 0)
+  {
+    float f = mantissa * 5.9604644775390625e-8f; // 2^-24, exact
+    memcpy(&x, &f, sizeof(x));
+    x |= sign;
+  }
+  else if (exponent == 31)
+  {
+    // NaNs come back quiet, as vcvtph2ps does
+    x = sign | 0x7F800000 | (mantissa << 13) | (mantissa ? 0x400000 : 0);
+  }
+  else
+  {
+    x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+static uint16_t FloatToBf16(float f)
+{
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+
+  if ((x & 0x7FFFFFFF) > 0x7F800000)
+    return (x >> 16) | 0x40;
+
+  x += 0x7FFF + ((x >> 16) & 1);
+  return x >> 16;
+}
+
+static float Bf16ToFloat(uint16_t h)
+{
+  uint32_t x = static_cast<uint32_t>(h) << 16;
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+static void EncodeScalar(uint32_t wire, const float * in, uint16_t * out,
+  uint64_t begin, uint64_t end)
+{
+  for (uint64_t i = begin; i < end; i++)
+    out[i] = WIRE_FP16 == wire ? FloatToHalf(in[i]) : FloatToBf16(in[i]);
+}
+
+static void DecodeScalar(uint32_t wire, const uint16_t * in, float * out,
+  uint64_t begin, uint64_t end)
+{
+  for (uint64_t i = begin; i < end; i++)
+    out[i] = WIRE_FP16 == wire ? HalfToFloat(in[i]) : Bf16ToFloat(in[i]);
+}
+
+__attribute__((target("avx2,f16c")))
+static void EncodeAvx2(uint32_t wire, const float * in, uint16_t * out,
+  uint64_t begin, uint64_t end)
+{
+  uint64_t i = begin;
+
+  if (WIRE_FP16 == wire)
+  {
+    for (; i + 8 <= end; i += 8)
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+        _mm256_cvtps_ph(_mm256_loadu_ps(in + i),
+        _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+  }
+  else
+  {
+    for (; i + 8 <= end; i += 8)
+    {
+      __m256 x = _mm256_loadu_ps(in + i);
+      __m256i u = _mm256_castps_si256(x);
+      __m256i upper = _mm256_srli_epi32(u, 16);
+
+      __m256i r = _mm256_srli_epi32(_mm256_add_epi32(u, _mm256_add_epi32(
+        _mm256_set1_epi32(0x7FFF), _mm256_and_si256(upper,
+        _mm256_set1_epi32(1)))), 16);
+      r = _mm256_blendv_epi8(r, _mm256_or_si256(upper,
+        _mm256_set1_epi32(0x40)),
+        _mm256_castps_si256(_mm256_cmp_ps(x, x, _CMP_UNORD_Q)));
+
+      // 32 -> 16 bits, packus works per 128 bit lane
+      r = _mm256_permute4x64_epi64(_mm256_packus_epi32(r, r), 0x08);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+        _mm256_castsi256_si128(r));
+    }
+  }
+
+  EncodeScalar(wire, in, out, i, end);
+}
+
+__attribute__((target("avx2,f16c")))
+static void DecodeAvx2(uint32_t wire, const uint16_t * in, float * out,
+  uint64_t begin, uint64_t end)
+{
+  uint64_t i = begin;
+
+  for (; i + 8 <= end; i += 8)
+  {
+    __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+
+    _mm256_storeu_ps(out + i, WIRE_FP16 == wire ? _mm256_cvtph_ps(h) :
+      _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16)));
+  }
+
+  DecodeScalar(wire, in, out, i, end);
+}
+
+__attribute__((target("avx512f")))
+static void EncodeAvx512(uint32_t wire, const float * in, uint16_t * out,
+  uint64_t begin, uint64_t end)
+{
+  uint64_t i = begin;
+
+  for (; i + 16 <= end; i += 16)
+  {
+    __m512 x = _mm512_loadu_ps(in + i);
+    __m256i h;
+
+    if (WIRE_FP16 == wire)
+    {
+      h = _mm512_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    }
+    else
+    {
+      __m512i u = _mm512_castps_si512(x);
+      __m512i upper = _mm512_srli_epi32(u, 16);
+
+      __m512i r = _mm512_srli_epi32(_mm512_add_epi32(u, _mm512_add_epi32(
+        _mm512_set1_epi32(0x7FFF), _mm512_and_si512(upper,
+        _mm512_set1_epi32(1)))), 16);
+      r = _mm512_mask_blend_epi32(_mm512_cmp_ps_mask(x, x, _CMP_UNORD_Q), r,
+        _mm512_or_si512(upper, _mm512_set1_epi32(0x40)));
+
+      h = _mm512_cvtepi32_epi16(r);
+    }
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), h);
+  }
+
+  EncodeScalar(wire, in, out, i, end);
+}
+
+__attribute__((target("avx512f")))
+static void DecodeAvx512(uint32_t wire, const uint16_t * in, float * out,
+  uint64_t begin, uint64_t end)
+{
+  uint64_t i = begin;
+
+  for (; i + 16 <= end; i += 16)
+  {
+    __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+
+    _mm512_storeu_ps(out + i, WIRE_FP16 == wire ? _mm512_cvtph_ps(h) :
+      _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(h), 16)));
+  }
+
+  DecodeScalar(wire, in, out, i, end);
+}
+
+static void VerifyWireRange(uint32_t wire, const float * one,
+  const float * two, const float * out, uint64_t begin, uint64_t end,
+  WireResult * result)
+{
+  double scale = 2 * HostBackend::WireEpsilon(wire) + std::ldexp(1.0, -23);
+  double floor = 3 * HostBackend::WireTiny(wire);
+
+  for (uint64_t i = begin; i < end; i++)
+  {
+    double exact = static_cast<double>(one[i]) + two[i];
+    double error = std::fabs(out[i] - exact);
+    double bound = scale * (std::fabs(one[i]) + std::fabs(two[i])) + floor;
+
+    // NaN errors (an infinity, or NaN inputs) fail as well
+    if (!(error <= bound))
+    {
+      if (result->over_bound == 0)
+        result->first_bad = i;
+      result->over_bound++;
+      continue;
+    }
+
+    result->max_abs = std::max(result->max_abs, error);
+    result->max_bound = std::max(result->max_bound, error / bound);
+    if (exact != 0)
+      result->max_rel = std::max(result->max_rel, error / std::fabs(exact));
+  }
+}
+
+//
+// Philox generation of elements [begin, end) of a stream into out[0, ...).
+// Whole blocks are written directly, partial ones at either end element by
+// element.
+//
+
+static void GenerateRange(float * out, uint64_t first, uint64_t begin,
+  uint64_t end, uint32_t stream, uint64_t seed)
+{
+  uint32_t words[4];
+  uint64_t e = begin;
+
+  for (; e < end && (e % 4) != 0; e++)
+    out[e - first] = PhiloxElement(e, stream, seed);
+
+  for (; e + 4 <= end; e += 4)
+  {
+    Philox4x32(e / 4, stream, seed, words);
+
+    for (uint32_t k = 0; k < 4; k++)
+      out[e - first + k] = PhiloxToUniform(words[k]);
+  }
+
+  for (; e < end; e++)
+    out[e - first] = PhiloxElement(e, stream, seed);
+}
+
+//
+// Other element types. Integers are made from the uniform's 24 bits, centred
+// on 0, so sums of two never overflow; sums of other integers wrap around.
+//
+
+template <typename T>
+static T FromUniform(float u)
+{
+  return static_cast<T>(u);
+}
+
+template <>
+int32_t FromUniform<int32_t>(float u)
+{
+  return static_cast<int32_t>(u * 16777216.0f) - 8388608;
+}
+
+template <>
+int64_t FromUniform<int64_t>(float u)
+{
+  return static_cast<int64_t>(u * 16777216.0f) - 8388608;
+}
+
+template <typename T>
+static T SumElement(T a, T b)
+{
+  return a + b;
+}
+
+static int32_t SumElement(int32_t a, int32_t b)
+{
+  return static_cast<int32_t>(static_cast<uint32_t>(a) +
+    static_cast<uint32_t>(b));
+}
+
+static int64_t SumElement(int64_t a, int64_t b)
+{
+  return static_cast<int64_t>(static_cast<uint64_t>(a) +
+    static_cast<uint64_t>(b));
+}
+
+template <typename T>
+static void GenerateTypedRange(T * out, uint64_t first, uint64_t begin,
+  uint64_t end, uint32_t stream, uint64_t seed)
+{
+  float block[4096];
+
+  for (uint64_t b = begin; b < end; b += 4096)
+  {
+    uint64_t stop = std::min<uint64_t>(end, b + 4096);
+
+    GenerateRange(block, b, b, stop, stream, seed);
+
+    for (uint64_t e = b; e < stop; e++)
+      out[e - first] = FromUniform<T>(block[e - b]);
+  }
+}
+
+template <typename T>
+static void SumTypedRange(const T * one, const T * two, T * out,
+  uint64_t begin, uint64_t end)
+{
+  for (uint64_t i = begin; i < end; i++)
+    out[i] = SumElement(one[i], two[i]);
+}
+
+template <typename T>
+static uint64_t VerifyTypedRange(const T * one, const T * two, const T * out,
+  uint64_t begin, uint64_t end, uint64_t * first_bad)
+{
+  uint64_t bad = 0;
+
+  for (uint64_t i = begin; i < end; i++)
+  {
+    T expected = SumElement(one[i], two[i]);
+
+    if (memcmp(&expected, &out[i], sizeof(T)) != 0)
+    {
+      if (bad == 0)
+        *first_bad = i;
+      bad++;
+    }
+  }
+
+  return bad;
+}
+
+//
+// Elements [begin, end) of n, one read (or written) sequentially, the other
+// as one sequential stream per component
+//
+template <typename T>
+static void ToSoARange(const T * aos, T * soa, uint32_t components,
+  uint64_t n, uint64_t begin, uint64_t end)
+{
+  for (uint64_t i = begin; i < end; i++)
+    for (uint32_t k = 0; k < components; k++)
+      soa[k * n + i] = aos[i * components + k];
+}
+
+template <typename T>
+static void FromSoARange(const T * soa, T * aos, uint32_t components,
+  uint64_t n, uint64_t begin, uint64_t end)
+{
+  for (uint64_t i = begin; i < end; i++)
+    for (uint32_t k = 0; k < components; k++)
+      aos[i * components + k] = soa[k * n + i];
+}
+
+//*********************************************************************
+//
+// HostBackend Constructors/Destructors
+//
+//*********************************************************************
+//
+// Constructor(s)
+//
+HostBackend::HostBackend(uint32_t n_threads)
+{
+  this->n_threads = n_threads > 0 ? n_threads :
+    std::max(1u, std::thread::hardware_concurrency());
+
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx512f"))
+    this->isa = ISA_AVX512;
+  else if (__builtin_cpu_supports("avx2"))
+    this->isa = ISA_AVX2;
+  else
+    this->isa = ISA_SCALAR;
+
+  this->f16c = __builtin_cpu_supports("f16c");
+}
+
+//
+// Destructor
+//
+HostBackend::~HostBackend(){}
+
+uint32_t HostBackend::HowManyThreads()
+{
+  return this->n_threads;
+}
+
+std::string HostBackend::IsaString()
+{
+  const char * names[] = {"scalar", "AVX2", "AVX-512"};
+  return names[this->isa];
+}
+
+//*********************************************************************
+//
+// HostBackend Operations
+//
+//*********************************************************************
+//
+// Work is split into one contiguous range per thread, each a multiple of 16
+// elements (one cache line) except the last, so threads never share a line
+// of out. fn gets the thread's index and its [begin, end).
+//
+void HostBackend::ParallelFor(uint64_t n,
+  const std::function<void(uint32_t, uint64_t, uint64_t)> & fn)
+{
+  uint64_t per_thread = ((n / this->n_threads) + 15) & ~15ULL;
+  std::vector<std::thread> workers;
+
+  for (uint32_t t = 0; t < this->n_threads; t++)
+  {
+    uint64_t begin = std::min(n, t * per_thread);
+    uint64_t end = (t + 1 == this->n_threads) ? n :
+      std::min(n, begin + per_thread);
+
+    if (begin < end)
+      workers.push_back(std::thread(fn, t, begin, end));
+  }
+
+  for (uint32_t w = 0; w < workers.size(); w++)
+    workers.at(w).join();
+}
+
+
+void HostBackend::Sum(const float * one, const float * two, float * out,
+  uint64_t n)
+{
+  void (*kernel)(const float *, const float *, float *, uint64_t, uint64_t) =
+    this->isa == ISA_AVX512 ? SumAvx512 :
+    this->isa == ISA_AVX2 ? SumAvx2 : SumScalar;
+
+  this->ParallelFor(n, [=](uint32_t, uint64_t begin, uint64_t end){
+    kernel(one, two, out, begin, end);
+  });
+}
+
+void HostBackend::Run(const KernelSignature & op, const float * const * in,
+  float * const * out, const double * params, uint64_t n)
+{
+  if (!op.host)
+    return;
+
+  if (op.entry == "Summer")
+  {
+    this->Sum(in[0], in[1], out[0], n);
+    return;
+  }
+
+  std::vector<float> float_params(op.param_names.size());
+
+  for (uint32_t p = 0; p < float_params.size(); p++)
+    float_params.at(p) = ParamAs<float>(params[p]);
+
+  this->ParallelFor(n, [&](uint32_t, uint64_t begin, uint64_t end){
+    op.host(in, out, float_params.data(), begin, end);
+  });
+}
+
+void HostBackend::Generate(float * out, uint64_t first, uint64_t n,
+  uint32_t stream, uint64_t seed)
+{
+  this->ParallelFor(n, [=](uint32_t, uint64_t begin, uint64_t end){
+    GenerateRange(out, first, first + begin, first + end, stream, seed);
+  });
+}
+
+void HostBackend::Encode(uint32_t wire, const float * in, uint16_t * out,
+  uint64_t n)
+{
+  void (*encode)(uint32_t, const float *, uint16_t *, uint64_t, uint64_t) =
+    EncodeScalar;
+
+  if (ISA_AVX512 == this->isa)
+    encode = EncodeAvx512;
+  else if (ISA_AVX2 == this->isa && this->f16c)
+    encode = EncodeAvx2;
+
+  encode(wire, in, out, 0, n);
+}
+
+void HostBackend::Decode(uint32_t wire, const uint16_t * in, float * out,
+  uint64_t n)
+{
+  void (*decode)(uint32_t, const uint16_t *, float *, uint64_t, uint64_t) =
+    DecodeScalar;
+
+  if (ISA_AVX512 == this->isa)
+    decode = DecodeAvx512;
+  else if (ISA_AVX2 == this->isa && this->f16c)
+    decode = DecodeAvx2;
+
+  decode(wire, in, out, 0, n);
+}
+
+void HostBackend::Generate(uint32_t type, void * out, uint64_t first,
+  uint64_t n, uint32_t stream, uint64_t seed)
+{
+  if (TYPE_DOUBLE == type)
+    this->GenerateOf(static_cast<double*>(out), first, n, stream, seed);
+  else if (TYPE_INT == type)
+    this->GenerateOf(static_cast<int32_t*>(out), first, n, stream, seed);
+  else if (TYPE_LONG == type)
+    this->GenerateOf(static_cast<int64_t*>(out), first, n, stream, seed);
+  else
+    this->Generate(static_cast<float*>(out), first, n, stream, seed);
+}
+
+void HostBackend::Sum(uint32_t type, const void * one, const void * two,
+  void * out, uint64_t n)
+{
+  if (TYPE_DOUBLE == type)
+    this->SumOf(static_cast<const double*>(one),
+      static_cast<const double*>(two), static_cast<double*>(out), n);
+  else if (TYPE_INT == type)
+    this->SumOf(static_cast<const int32_t*>(one),
+      static_cast<const int32_t*>(two), static_cast<int32_t*>(out), n);
+  else if (TYPE_LONG == type)
+    this->SumOf(static_cast<const int64_t*>(one),
+      static_cast<const int64_t*>(two), static_cast<int64_t*>(out), n);
+  else
+    this->Sum(static_cast<const float*>(one), static_cast<const float*>(two),
+      static_cast<float*>(out), n);
+}
+
+VerifyResult HostBackend::Verify(uint32_t type, const void * one,
+  const void * two, const void * out, uint64_t n)
+{
+  if (TYPE_DOUBLE == type)
+    return this->VerifyOf(static_cast<const double*>(one),
+      static_cast<const double*>(two), static_cast<const double*>(out), n);
+  else if (TYPE_INT == type)
+    return this->VerifyOf(static_cast<const int32_t*>(one),
+      static_cast<const int32_t*>(two), static_cast<const int32_t*>(out), n);
+  else if (TYPE_LONG == type)
+    return this->VerifyOf(static_cast<const int64_t*>(one),
+      static_cast<const int64_t*>(two), static_cast<const int64_t*>(out), n);
+  else
+    return this->Verify(static_cast<const float*>(one),
+      static_cast<const float*>(two), static_cast<const float*>(out), n);
+}
+
+template <typename T>
+void HostBackend::GenerateOf(T * out, uint64_t first, uint64_t n,
+  uint32_t stream, uint64_t seed)
+{
+  this->ParallelFor(n, [=](uint32_t, uint64_t begin, uint64_t end){
+    GenerateTypedRange(out, first, first + begin, first + end, stream, seed);
+  });
+}
+
+template <typename T>
+void HostBackend::SumOf(const T * one, const T * two, T * out, uint64_t n)
+{
+  this->ParallelFor(n, [=](uint32_t, uint64_t begin, uint64_t end){
+    SumTypedRange(one, two, out, begin, end);
+  });
+}
+
+template <typename T>
+VerifyResult HostBackend::VerifyOf(const T * one, const T * two,
+  const T * out, uint64_t n)
+{
+  std::vector<uint64_t> bad(this->n_threads, 0);
+  std::vector<uint64_t> first_bad(this->n_threads, 0);
+
+  this->ParallelFor(n, [&](uint32_t t, uint64_t begin, uint64_t end){
+    bad.at(t) = VerifyTypedRange(one, two, out, begin, end,
+      &first_bad.at(t));
+  });
+
+  VerifyResult result = {0, 0};
+
+  for (uint32_t t = 0; t < this->n_threads; t++)
+  {
+    if (bad.at(t) > 0 && result.mismatches == 0)
+      result.first_bad = first_bad.at(t);
+    result.mismatches += bad.at(t);
+  }
+
+  return result;
+}
+
+void HostBackend::Run(uint32_t type, const KernelSignature & op,
+  const void * const * in, void * const * out, const double * params,
+  uint64_t n)
+{
+  if (op.entry == "Summer")
+    this->Sum(type, in[0], in[1], out[0], n);
+  else if (TYPE_DOUBLE == type)
+    this->RunOf<double>(op, in, out, params, n);
+  else if (TYPE_INT == type)
+    this->RunOf<int32_t>(op, in, out, params, n);
+  else if (TYPE_LONG == type)
+    this->RunOf<int64_t>(op, in, out, params, n);
+  else
+    this->RunOf<float>(op, in, out, params, n);
+}
+
+VerifyResult HostBackend::Compare(uint32_t type, const void * expected,
+  const void * actual, uint64_t n)
+{
+  if (TYPE_DOUBLE == type)
+    return this->CompareOf(static_cast<const double*>(expected),
+      static_cast<const double*>(actual), n);
+  else if (TYPE_INT == type)
+    return this->CompareOf(static_cast<const int32_t*>(expected),
+      static_cast<const int32_t*>(actual), n);
+  else if (TYPE_LONG == type)
+    return this->CompareOf(static_cast<const int64_t*>(expected),
+      static_cast<const int64_t*>(actual), n);
+  else
+    return this->Compare(static_cast<const float*>(expected),
+      static_cast<const float*>(actual), n);
+}
+
+template <typename T>
+void HostBackend::RunOf(const KernelSignature & op, const void * const * in,
+  void * const * out, const double * params, uint64_t n)
+{
+  const HostKernelOf<T> & host = HostReference<T>(op);
+
+  if (!host)
+    return;
+
+  std::vector<const T *> typed_in(op.n_inputs);
+  std::vector<T *> typed_out(op.n_outputs);
+  std::vector<T> typed_params(op.param_names.size());
+
+  for (uint32_t b = 0; b < op.n_inputs; b++)
+    typed_in.at(b) = static_cast<const T*>(in[b]);
+  for (uint32_t b = 0; b < op.n_outputs; b++)
+    typed_out.at(b) = static_cast<T*>(out[b]);
+  for (uint32_t p = 0; p < typed_params.size(); p++)
+    typed_params.at(p) = ParamAs<T>(params[p]);
+
+  this->ParallelFor(n, [&](uint32_t, uint64_t begin, uint64_t end){
+    host(typed_in.data(), typed_out.data(), typed_params.data(), begin, end);
+  });
+}
+
+template <typename T>
+VerifyResult HostBackend::CompareOf(const T * expected, const T * actual,
+  uint64_t n)
+{
+  std::vector<uint64_t> bad(this->n_threads, 0);
+  std::vector<uint64_t> first_bad(this->n_threads, 0);
+
+  this->ParallelFor(n, [&](uint32_t t, uint64_t begin, uint64_t end){
+    bad.at(t) = CompareScalar(expected, actual, begin, end,
+      &first_bad.at(t));
+  });
+
+  VerifyResult result = {0, 0};
+
+  for (uint32_t t = 0; t < this->n_threads; t++)
+  {
+    if (bad.at(t) > 0 && result.mismatches == 0)
+      result.first_bad = first_bad.at(t);
+    result.mismatches += bad.at(t);
+  }
+
+  return result;
+}
+
+//
+// Components are only moved, so they are copied as unsigned integers of
+// their size.
+//
+void HostBackend::ToSoA(uint32_t type, uint32_t components, const void * aos,
+  void * soa, uint64_t n)
+{
+  if (GetElementInfo(type).size == sizeof(uint64_t))
+    this->Transpose(static_cast<const uint64_t*>(aos),
+      static_cast<uint64_t*>(soa), components, n, true);
+  else
+    this->Transpose(static_cast<const uint32_t*>(aos),
+      static_cast<uint32_t*>(soa), components, n, true);
+}
+
+void HostBackend::FromSoA(uint32_t type, uint32_t components,
+  const void * soa, void * aos, uint64_t n)
+{
+  if (GetElementInfo(type).size == sizeof(uint64_t))
+    this->Transpose(static_cast<const uint64_t*>(soa),
+      static_cast<uint64_t*>(aos), components, n, false);
+  else
+    this->Transpose(static_cast<const uint32_t*>(soa),
+      static_cast<uint32_t*>(aos), components, n, false);
+}
+
+template <typename T>
+void HostBackend::Transpose(const T * in, T * out, uint32_t components,
+  uint64_t n, bool to_soa)
+{
+  if (to_soa)
+    ToSoARange(in, out, components, n, 0, n);
+  else
+    FromSoARange(in, out, components, n, 0, n);
+}
+
+uint32_t HostBackend::WireSize(uint32_t wire)
+{
+  return WIRE_FP32 == wire ? sizeof(float) : sizeof(uint16_t);
+}
+
+double HostBackend::WireEpsilon(uint32_t wire)
+{
+  if (WIRE_FP16 == wire)
+    return std::ldexp(1.0, -11);
+  if (WIRE_BF16 == wire)
+    return std::ldexp(1.0, -8);
+
+  return std::ldexp(1.0, -24);
+}
+
+double HostBackend::WireTiny(uint32_t wire)
+{
+  if (WIRE_FP16 == wire)
+    return std::ldexp(1.0, -25);
+  if (WIRE_BF16 == wire)
+    return std::ldexp(1.0, -134);
+
+  return std::ldexp(1.0, -150);
+}
+
+VerifyResult HostBackend::Verify(const float * one, const float * two,
+  const float * out, uint64_t n)
+{
+  uint64_t (*kernel)(const float *, const float *, const float *, uint64_t,
+    uint64_t, uint64_t *) =
+    this->isa == ISA_AVX512 ? VerifyAvx512 :
+    this->isa == ISA_AVX2 ? VerifyAvx2 : VerifyScalar;
+
+  std::vector<uint64_t> bad(this->n_threads, 0);
+  std::vector<uint64_t> first_bad(this->n_threads, 0);
+
+  this->ParallelFor(n, [&](uint32_t t, uint64_t begin, uint64_t end){
+    bad.at(t) = kernel(one, two, out, begin, end, &first_bad.at(t));
+  });
+
+  VerifyResult result = {0, 0};
+
+  // threads cover increasing ranges, so the first thread with a mismatch
+  // holds the overall first one
+  for (uint32_t t = 0; t < this->n_threads; t++)
+  {
+    if (bad.at(t) > 0 && result.mismatches == 0)
+      result.first_bad = first_bad.at(t);
+    result.mismatches += bad.at(t);
+  }
+
+  return result;
+}
+
+WireResult HostBackend::VerifyWire(uint32_t wire, const float * one,
+  const float * two, const float * out, uint64_t n)
+{
+  WireResult none = {0, 0, 0, 0, 0};
+  std::vector<WireResult> partial(this->n_threads, none);
+
+  this->ParallelFor(n, [&](uint32_t t, uint64_t begin, uint64_t end){
+    VerifyWireRange(wire, one, two, out, begin, end, &partial.at(t));
+  });
+
+  WireResult result = none;
+
+  // as in Verify(), the first thread over the bound has the first entry
+  for (uint32_t t = 0; t < this->n_threads; t++)
+  {
+    const WireResult * p = &partial.at(t);
+
+    if (p->over_bound > 0 && result.over_bound == 0)
+      result.first_bad = p->first_bad;
+    result.over_bound += p->over_bound;
+    result.max_abs = std::max(result.max_abs, p->max_abs);
+    result.max_rel = std::max(result.max_rel, p->max_rel);
+    result.max_bound = std::max(result.max_bound, p->max_bound);
+  }
+
+  return result;
+}
+
+double HostBackend::Reduce(uint32_t reduce, const float * one,
+  const float * two, uint64_t n)
+{
+  std::vector<double> partial(this->n_threads, ReduceIdentity(reduce));
+
+  this->ParallelFor(n, [&](uint32_t t, uint64_t begin, uint64_t end){
+    partial.at(t) = ReduceScalar(reduce, one, two, begin, end);
+  });
+
+  double x = ReduceIdentity(reduce);
+
+  for (uint32_t t = 0; t < this->n_threads; t++)
+    x = ReduceCombine(reduce, x, partial.at(t));
+
+  return x;
+}
+
+double HostBackend::ReduceIdentity(uint32_t reduce)
+{
+  if (REDUCE_MIN == reduce)
+    return std::numeric_limits<double>::infinity();
+  else if (REDUCE_MAX == reduce)
+    return -std::numeric_limits<double>::infinity();
+  else
+    return 0.0;
+}
+
+double HostBackend::ReduceCombine(uint32_t reduce, double x, double y)
+{
+  if (REDUCE_MIN == reduce)
+    return std::min(x, y);
+  else if (REDUCE_MAX == reduce)
+    return std::max(x, y);
+  else
+    return x + y;
+}
+
+VerifyResult HostBackend::Compare(const float * expected,
+  const float * actual, uint64_t n)
+{
+  return this->CompareOf(expected, actual, n);
+}
+
+//EOF
@@ -0,0 +1,237 @@
+/*
+# hostbackend.h
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef  OCLPTX_HOSTBACKEND_H_
+#define  OCLPTX_HOSTBACKEND_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "kernelregistry.h"
+
+//
+// Native implementation of the element-wise operations: AVX-512 or AVX2 for
+// Summer (picked at run time from what the CPU supports, scalar otherwise),
+// the registry's host references for the rest, spread over a number of host
+// threads. Used both as an execution engine next to the OpenCL
+// devices and as the oracle that verifies complete outputs. The other
+// element types (double, int, long) run templates over the component type,
+// left to the compiler to vectorise.
+//
+
+enum HostIsa
+{
+  ISA_SCALAR,
+  ISA_AVX2,
+  ISA_AVX512
+};
+
+//
+// Reductions of a chunk (see kernels/reduce.cl) and how their per chunk
+// results are combined
+//
+enum ReduceKind
+{
+  REDUCE_NONE,  // element-wise outputs, read back in full
+  REDUCE_SUM,   // sum of the first output
+  REDUCE_MIN,   // smallest element of the first output
+  REDUCE_MAX,   // largest element of the first output
+  REDUCE_DOT    // sum of in1 * in2, the operation itself is not run
+};
+
+//
+// Element format of the device buffers and of the transfers to and from them.
+// The host arrays are always float; 16 bit formats are converted on the way.
+//
+enum WireFormat
+{
+  WIRE_FP32,  // float, no conversion
+  WIRE_FP16,  // IEEE half precision, round to nearest even
+  WIRE_BF16   // upper 16 bits of a float, round to nearest even
+};
+
+struct VerifyResult
+{
+  uint64_t mismatches;
+  uint64_t first_bad; // only meaningful if mismatches > 0
+};
+
+struct WireResult
+{
+  uint64_t over_bound; // entries whose error exceeds the bound
+  uint64_t first_bad; // only meaningful if over_bound > 0
+  double max_abs; // largest absolute error
+  double max_rel; // largest error relative to the exact value, if not 0
+  double max_bound; // largest error as a fraction of its bound
+};
+
+class HostBackend{
+
+  public:
+
+    // n_threads == 0 uses every hardware thread
+    HostBackend(uint32_t n_threads = 0);
+
+    ~HostBackend();
+
+    uint32_t HowManyThreads();
+
+    std::string IsaString();
+
+    //
+    // Operations, all split across HowManyThreads() threads
+    //
+
+    // out[i] = one[i] + two[i]
+    void Sum(const float * one, const float * two, float * out, uint64_t n);
+
+    // counts i with out[i] != one[i] + two[i] (bitwise float equality)
+    VerifyResult Verify(const float * one, const float * two,
+      const float * out, uint64_t n);
+
+    // Error of out[i] against one[i] + two[i] (in double) when the inputs
+    // and out were rounded to wire (unit roundoff u) and the sum to float.
+    // The bound is (2u + 2^-23)(|one[i]| + |two[i]|) + 3 WireTiny(wire);
+    // values beyond the format's range (fp16: 65504) exceed it.
+    WireResult VerifyWire(uint32_t wire, const float * one, const float * two,
+      const float * out, uint64_t n);
+
+    // any registered operation, params converted by ParamAs(); the SIMD
+    // Sum() for "sum"
+    void Run(const KernelSignature & op, const float * const * in,
+      float * const * out, const double * params, uint64_t n);
+
+    // reduce (a ReduceKind) of one[0, n), or for REDUCE_DOT of one * two,
+    // accumulated in double
+    double Reduce(uint32_t reduce, const float * one, const float * two,
+      uint64_t n);
+
+    static double ReduceIdentity(uint32_t reduce);
+
+    static double ReduceCombine(uint32_t reduce, double x, double y);
+
+    // counts i with actual[i] != expected[i] (bitwise float equality)
+    VerifyResult Compare(const float * expected, const float * actual,
+      uint64_t n);
+
+    // out[i] = element first + i of Philox stream (see philox.h)
+    void Generate(float * out, uint64_t first, uint64_t n, uint32_t stream,
+      uint64_t seed);
+
+    //
+    // 16 bit wire formats (WireFormat), F16C/AVX-512 where available. These
+    // convert one chunk at a time on the calling thread: every device worker
+    // converts its own chunks.
+    //
+
+    void Encode(uint32_t wire, const float * in, uint16_t * out, uint64_t n);
+
+    void Decode(uint32_t wire, const uint16_t * in, float * out, uint64_t n);
+
+    // bytes per element
+    static uint32_t WireSize(uint32_t wire);
+
+    // unit roundoff of a conversion to wire, relative to the value
+    static double WireEpsilon(uint32_t wire);
+
+    // largest rounding error of a conversion of a value near zero (absolute,
+    // subnormals)
+    static double WireTiny(uint32_t wire);
+
+    //
+    // Any component ElementType (TYPE_FLOAT, TYPE_DOUBLE, TYPE_INT,
+    // TYPE_LONG), floats go to the versions above. Integer sums wrap around.
+    //
+
+    // out[i] = element first + i of Philox stream as type: the float, or for
+    // integers its 24 bits less 2^23
+    void Generate(uint32_t type, void * out, uint64_t first, uint64_t n,
+      uint32_t stream, uint64_t seed);
+
+    void Sum(uint32_t type, const void * one, const void * two, void * out,
+      uint64_t n);
+
+    // bitwise equality
+    VerifyResult Verify(uint32_t type, const void * one, const void * two,
+      const void * out, uint64_t n);
+
+    // op's host reference over type, params converted to it by ParamAs();
+    // the SIMD Sum() for "sum"
+    void Run(uint32_t type, const KernelSignature & op,
+      const void * const * in, void * const * out, const double * params,
+      uint64_t n);
+
+    // counts i with actual[i] != expected[i]
+    VerifyResult Compare(uint32_t type, const void * expected,
+      const void * actual, uint64_t n);
+
+    //
+    // Layouts of n elements of components components each (see Layout):
+    // interleaved (x0 y0 z0 x1 ...) to one array per component (x0 x1 ...
+    // y0 y1 ... z0 z1 ...) and back, on the calling thread like the wire
+    // conversions
+    //
+
+    void ToSoA(uint32_t type, uint32_t components, const void * aos,
+      void * soa, uint64_t n);
+
+    void FromSoA(uint32_t type, uint32_t components, const void * soa,
+      void * aos, uint64_t n);
+
+  private:
+
+    // runs fn(t, begin, end) on thread t for each thread's range of [0, n)
+    void ParallelFor(uint64_t n,
+      const std::function<void(uint32_t, uint64_t, uint64_t)> & fn);
+
+    template <typename T>
+    void Transpose(const T * in, T * out, uint32_t components, uint64_t n,
+      bool to_soa);
+
+    template <typename T>
+    void GenerateOf(T * out, uint64_t first, uint64_t n, uint32_t stream,
+      uint64_t seed);
+
+    template <typename T>
+    void SumOf(const T * one, const T * two, T * out, uint64_t n);
+
+    template <typename T>
+    VerifyResult VerifyOf(const T * one, const T * two, const T * out,
+      uint64_t n);
+
+    template <typename T>
+    void RunOf(const KernelSignature & op, const void * const * in,
+      void * const * out, const double * params, uint64_t n);
+
+    template <typename T>
+    VerifyResult CompareOf(const T * expected, const T * actual, uint64_t n);
+
+    uint32_t n_threads;
+
+    uint32_t isa;
+
+    bool f16c; // AVX2 conversions need F16C as well
+};
+
+#endif
+
+//EOF
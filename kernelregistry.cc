@@ -0,0 +1,194 @@
+/*
+# kernelregistry.cc
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <type_traits>
+
+#include "kernelregistry.h"
+
+//*********************************************************************
+//
+// Host References
+//
+//*********************************************************************
+//
+// Written to round exactly like the kernels in kernels/elementwise.cl (no
+// contraction on either side, fma where the kernel calls fma), so outputs can
+// be compared bit for bit. Integer results wrap around, as the kernels' do:
+// the arithmetic is done unsigned, where overflow is defined.
+//
+
+template <typename T, bool = std::is_integral<T>::value>
+struct Wrapping
+{
+  typedef T type;
+};
+
+template <typename T>
+struct Wrapping<T, true>
+{
+  typedef typename std::make_unsigned<T>::type type;
+};
+
+template <typename T>
+static T Add(T a, T b)
+{
+  typedef typename Wrapping<T>::type U;
+
+  return static_cast<T>(static_cast<U>(a) + static_cast<U>(b));
+}
+
+template <typename T>
+static T Mul(T a, T b)
+{
+  typedef typename Wrapping<T>::type U;
+
+  return static_cast<T>(static_cast<U>(a) * static_cast<U>(b));
+}
+
+// integers have no fma, the kernels multiply and add (T_INTEGER)
+template <typename T>
+static T Fma(T a, T b, T c)
+{
+  return Add(Mul(a, b), c);
+}
+
+static float Fma(float a, float b, float c)
+{
+  return std::fma(a, b, c);
+}
+
+static double Fma(double a, double b, double c)
+{
+  return std::fma(a, b, c);
+}
+
+template <typename T>
+static void HostSum(const T * const * in, T * const * out, const T *,
+  uint64_t begin, uint64_t end)
+{
+  for (uint64_t i = begin; i < end; i++)
+    out[0][i] = Add(in[0][i], in[1][i]);
+}
+
+template <typename T>
+static void HostAxpy(const T * const * in, T * const * out, const T * params,
+  uint64_t begin, uint64_t end)
+{
+  for (uint64_t i = begin; i < end; i++)
+    out[0][i] = Add(Mul(params[0], in[0][i]), in[1][i]);
+}
+
+template <typename T>
+static void HostFma(const T * const * in, T * const * out, const T *,
+  uint64_t begin, uint64_t end)
+{
+  for (uint64_t i = begin; i < end; i++)
+    out[0][i] = Fma(in[0][i], in[1][i], in[2][i]);
+}
+
+template <typename T>
+static void HostScale(const T * const * in, T * const * out,
+  const T * params, uint64_t begin, uint64_t end)
+{
+  for (uint64_t i = begin; i < end; i++)
+    out[0][i] = Mul(params[0], in[0][i]);
+}
+
+template <typename T>
+static void HostClamp(const T * const * in, T * const * out,
+  const T * params, uint64_t begin, uint64_t end)
+{
+  for (uint64_t i = begin; i < end; i++)
+    out[0][i] = std::min(std::max(in[0][i], params[0]), params[1]);
+}
+
+//*********************************************************************
+//
+// Registry
+//
+//*********************************************************************
+
+static const KernelSignature registry[] =
+{
+  {"sum", "elementwise.cl", "Summer", "out = a + b", "$0 + $1", 2, 1,
+    {}, {}, HostSum<float>, "",
+    HostSum<double>, HostSum<int32_t>, HostSum<int64_t>},
+  {"axpy", "elementwise.cl", "Axpy", "out = a * x + y", "$p0 * $0 + $1", 2, 1,
+    {"a"}, {2.0}, HostAxpy<float>, "",
+    HostAxpy<double>, HostAxpy<int32_t>, HostAxpy<int64_t>},
+  {"fma", "elementwise.cl", "Fma", "out = fma(a, b, c)", "fma($0, $1, $2)",
+    3, 1, {}, {}, HostFma<float>, "",
+    HostFma<double>, HostFma<int32_t>, HostFma<int64_t>},
+  {"scale", "elementwise.cl", "Scale", "out = a * x", "$p0 * $0", 1, 1,
+    {"a"}, {2.0}, HostScale<float>, "",
+    HostScale<double>, HostScale<int32_t>, HostScale<int64_t>},
+  {"clamp", "elementwise.cl", "Clamp", "out = clamp(x, lo, hi)",
+    "clamp($0, $p0, $p1)", 1, 1, {"lo", "hi"}, {0.25, 0.75},
+    HostClamp<float>, "",
+    HostClamp<double>, HostClamp<int32_t>, HostClamp<int64_t>}
+};
+
+const KernelSignature * KernelRegistry::Find(std::string name)
+{
+  for (uint32_t k = 0; k < HowManyKernels(); k++)
+  {
+    if (registry[k].name == name)
+      return &registry[k];
+  }
+
+  return NULL;
+}
+
+uint32_t KernelRegistry::HowManyKernels()
+{
+  return sizeof(registry) / sizeof(registry[0]);
+}
+
+const KernelSignature * KernelRegistry::Get(uint32_t k)
+{
+  return k < HowManyKernels() ? &registry[k] : NULL;
+}
+
+void KernelRegistry::PrintKernels()
+{
+  puts("Element-wise operations (-op=):");
+
+  for (uint32_t k = 0; k < HowManyKernels(); k++)
+  {
+    const KernelSignature & sig = registry[k];
+    std::string params;
+
+    for (uint32_t p = 0; p < sig.param_names.size(); p++)
+    {
+      char value[32];
+      snprintf(value, sizeof(value), "%g", sig.param_defaults.at(p));
+      params += (p ? ", " : "") + sig.param_names.at(p) + "=" + value;
+    }
+
+    printf("  %-6s %-24s %d in, %d out%s%s\n", sig.name.c_str(),
+      sig.formula.c_str(), sig.n_inputs, sig.n_outputs,
+      params.empty() ? "" : ", params: ", params.c_str());
+  }
+}
+
+//EOF
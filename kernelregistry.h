@@ -0,0 +1,139 @@
+/*
+# kernelregistry.h
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef  OCLPTX_KERNELREGISTRY_H_
+#define  OCLPTX_KERNELREGISTRY_H_
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+
+//
+// Element-wise kernels the chunk pipeline can run. Each is described by a
+// signature: how many input and output arrays it has and which scalar
+// parameters follow them, so buffers, transfers, kernel arguments, the host
+// backend and verification can all be set up without knowing the operation.
+//
+// Kernel arguments are always
+//
+//   in[0], ..., in[n_inputs - 1], out[0], ..., out[n_outputs - 1],
+//   uint n (elements in the chunk), T params[0], ...
+//
+// where T is the component type the kernel is built for (-DT=, float by
+// default). Parameters are given as double and converted to T by ParamAs(),
+// for the kernel arguments and the host references alike.
+//
+
+// Host reference of a kernel over T, over elements [begin, end) of the arrays
+template <typename T>
+using HostKernelOf = std::function<void(const T * const * in,
+  T * const * out, const T * params, uint64_t begin, uint64_t end)>;
+
+typedef HostKernelOf<float> HostKernel;
+
+struct KernelSignature
+{
+  std::string name; // -op= name
+  std::string file; // source in kernels/
+  std::string entry; // __kernel function
+  std::string formula; // for the help text
+  std::string expression; // OpenCL C for one element, used by FusedKernel:
+                          // $0, $1, ... inputs, $p0, $p1, ... parameters
+  uint32_t n_inputs;
+  uint32_t n_outputs;
+  std::vector<std::string> param_names;
+  std::vector<double> param_defaults;
+  HostKernel host;
+  std::string generated; // appended to file, for generated kernels
+
+  // host references over the other component types, empty for float only
+  // kernels (generated ones)
+  HostKernelOf<double> host_double;
+  HostKernelOf<int32_t> host_int;
+  HostKernelOf<int64_t> host_long;
+};
+
+// op's host reference over T: float, double, int32_t or int64_t
+template <typename T>
+const HostKernelOf<T> & HostReference(const KernelSignature & op);
+
+template <>
+inline const HostKernelOf<float> & HostReference(const KernelSignature & op)
+{
+  return op.host;
+}
+
+template <>
+inline const HostKernelOf<double> & HostReference(const KernelSignature & op)
+{
+  return op.host_double;
+}
+
+template <>
+inline const HostKernelOf<int32_t> & HostReference(
+  const KernelSignature & op)
+{
+  return op.host_int;
+}
+
+template <>
+inline const HostKernelOf<int64_t> & HostReference(
+  const KernelSignature & op)
+{
+  return op.host_long;
+}
+
+// param as T: rounded for float, truncated toward zero and saturated to the
+// range of the integer types (NaN gives 0)
+template <typename T>
+inline T ParamAs(double param)
+{
+  if (std::numeric_limits<T>::is_integer)
+  {
+    if (param != param)
+      return 0;
+    if (param <= static_cast<double>(std::numeric_limits<T>::min()))
+      return std::numeric_limits<T>::min();
+    if (param >= static_cast<double>(std::numeric_limits<T>::max()))
+      return std::numeric_limits<T>::max();
+  }
+
+  return static_cast<T>(param);
+}
+
+class KernelRegistry{
+
+  public:
+
+    // NULL if there is no kernel called name
+    static const KernelSignature * Find(std::string name);
+
+    static uint32_t HowManyKernels();
+
+    static const KernelSignature * Get(uint32_t k);
+
+    static void PrintKernels();
+};
+
+#endif
+
+//EOF
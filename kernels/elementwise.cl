@@ -0,0 +1,239 @@
+/*
+# elementwise.cl
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Element-wise kernels, see kernelregistry.cc for their signatures. Every
+// kernel takes its inputs, then its outputs, then the element count of the
+// chunk, then its scalar parameters. Fused kernels generated by FusedKernel
+// are appended to this file and use the same macros.
+//
+// Build time specialisation (OclEnv::KernelOptions):
+//
+//   -DVEC=n        load/compute/store floatn vectors (1, 2, 4, 8 or 16)
+//   -DELEMS=n      vectors per work-item, spaced a whole NDRange apart so
+//                  neighbouring work-items still access neighbouring vectors
+//   -DGRID_STRIDE  ignore ELEMS; loop over the whole chunk in steps of the
+//                  NDRange size, for a fixed, device sized launch
+//   -DT=type       element type of Summer, Axpy, Fma, Scale and Clamp: float
+//                  (default), double, int or long; parameters are passed as T
+//   -DT_INTEGER    T is int or long, which have no fma
+//
+// The elements past the last whole vector are done one per work-item by the
+// first (n % VEC) work-items. OclEnv::KernelRange() sizes the launch.
+
+// results must match the host backend bit for bit, so a * b + c is never
+// contracted into an fma
+#pragma OPENCL FP_CONTRACT OFF
+
+#ifndef VEC
+#define VEC 1
+#endif
+
+#ifndef ELEMS
+#define ELEMS 1
+#endif
+
+#ifndef T
+#define T float
+#endif
+
+#ifdef cl_khr_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+// integer results wrap around, as on the host (see kernelregistry.cc)
+#ifdef T_INTEGER
+#define FMA(a, b, c) ((a) * (b) + (c))
+#else
+#define FMA(a, b, c) fma(a, b, c)
+#endif
+
+#define CAT_(a, b) a ## b
+#define CAT(a, b) CAT_(a, b)
+
+#if VEC == 1
+#define VTYPE float
+#define VLOAD(i, p) ((p)[i])
+#define VSTORE(v, i, p) ((p)[i] = (v))
+#else
+#define VTYPE CAT(float, VEC)
+#define VLOAD(i, p) CAT(vload, VEC)(i, p)
+#define VSTORE(v, i, p) CAT(vstore, VEC)(v, i, p)
+#endif
+
+// 16 bit wire formats (HostBackend::Encode), widened to float on load and
+// rounded to nearest even on store. fp16 buffers are accessed as half, which
+// needs no cl_khr_fp16; bf16 buffers as ushort, the upper half of a float.
+
+#if VEC == 1
+#define UTYPE uint
+#define STYPE ushort
+#define VLOAD_HALF(i, p) vload_half(i, p)
+#define VSTORE_HALF(v, i, p) vstore_half_rte(v, i, p)
+#define ULOAD(i, p) ((p)[i])
+#define USTORE(v, i, p) ((p)[i] = (v))
+#else
+#define UTYPE CAT(uint, VEC)
+#define STYPE CAT(ushort, VEC)
+#define VLOAD_HALF(i, p) CAT(vload_half, VEC)(i, p)
+#define VSTORE_HALF(v, i, p) CAT(CAT(vstore_half, VEC), _rte)(v, i, p)
+#define ULOAD(i, p) CAT(vload, VEC)(i, p)
+#define USTORE(v, i, p) CAT(vstore, VEC)(v, i, p)
+#endif
+
+// bits of the bf16 nearest to the float with bits u, NaNs stay quiet NaNs
+#define BF16_BITS(u, nan) \
+  select(((u) + 0x7FFF + (((u) >> 16) & 1)) >> 16, ((u) >> 16) | 0x40, nan)
+
+#define VLOAD_BF16(i, p) \
+  CAT(as_, VTYPE)(CAT(convert_, UTYPE)(ULOAD(i, p)) << 16)
+#define VSTORE_BF16(v, i, p) USTORE(CAT(convert_, STYPE)( \
+  BF16_BITS(CAT(as_, UTYPE)(v), isnan(v))), i, p)
+
+// single elements, for the tails
+#define LOAD_BF16(i, p) as_float((uint)(p)[i] << 16)
+#define STORE_BF16(x, i, p) \
+  ((p)[i] = (ushort)BF16_BITS(as_uint(x), isnan(x)))
+
+// v runs over this work-item's vectors of an n element chunk
+#ifdef GRID_STRIDE
+#define FOR_VECTORS(v, n) \
+  for (uint v = get_global_id(0); v < (n) / VEC; v += get_global_size(0))
+#else
+#define FOR_VECTORS(v, n) \
+  for (uint k_ = 0, v = get_global_id(0); k_ < ELEMS && v < (n) / VEC; \
+    k_++, v += get_global_size(0))
+#endif
+
+// t is this work-item's element of the n % VEC tail, if it has one
+#define TAIL_ELEMENT(t, n) \
+  for (uint t = (n) / VEC * VEC + get_global_id(0); VEC > 1 && t < (n); \
+    t = (n))
+
+__kernel void Summer(
+  __global const T *set_one, // R
+  __global const T *set_two, // R
+  __global T *output,        // W
+  const uint n               // elements in this chunk
+)
+{
+  FOR_VECTORS(v, n)
+    VSTORE(VLOAD(v, set_one) + VLOAD(v, set_two), v, output);
+
+  TAIL_ELEMENT(t, n)
+    output[t] = set_one[t] + set_two[t];
+}
+
+// Summer over 16 bit wire formats, the sum itself is still done in float
+
+__kernel void SummerHalf(
+  __global const half *set_one,
+  __global const half *set_two,
+  __global half *output,
+  const uint n
+)
+{
+  FOR_VECTORS(v, n)
+    VSTORE_HALF(VLOAD_HALF(v, set_one) + VLOAD_HALF(v, set_two), v, output);
+
+  TAIL_ELEMENT(t, n)
+    vstore_half_rte(vload_half(t, set_one) + vload_half(t, set_two), t,
+      output);
+}
+
+__kernel void SummerBf16(
+  __global const ushort *set_one,
+  __global const ushort *set_two,
+  __global ushort *output,
+  const uint n
+)
+{
+  FOR_VECTORS(v, n)
+  {
+    VTYPE sum = VLOAD_BF16(v, set_one) + VLOAD_BF16(v, set_two);
+    VSTORE_BF16(sum, v, output);
+  }
+
+  TAIL_ELEMENT(t, n)
+  {
+    float sum = LOAD_BF16(t, set_one) + LOAD_BF16(t, set_two);
+    STORE_BF16(sum, t, output);
+  }
+}
+
+__kernel void Axpy(
+  __global const T *x,
+  __global const T *y,
+  __global T *output,
+  const uint n,
+  const T a
+)
+{
+  FOR_VECTORS(v, n)
+    VSTORE(a * VLOAD(v, x) + VLOAD(v, y), v, output);
+
+  TAIL_ELEMENT(t, n)
+    output[t] = a * x[t] + y[t];
+}
+
+__kernel void Fma(
+  __global const T *a,
+  __global const T *b,
+  __global const T *c,
+  __global T *output,
+  const uint n
+)
+{
+  FOR_VECTORS(v, n)
+    VSTORE(FMA(VLOAD(v, a), VLOAD(v, b), VLOAD(v, c)), v, output);
+
+  TAIL_ELEMENT(t, n)
+    output[t] = FMA(a[t], b[t], c[t]);
+}
+
+__kernel void Scale(
+  __global const T *x,
+  __global T *output,
+  const uint n,
+  const T a
+)
+{
+  FOR_VECTORS(v, n)
+    VSTORE(a * VLOAD(v, x), v, output);
+
+  TAIL_ELEMENT(t, n)
+    output[t] = a * x[t];
+}
+
+__kernel void Clamp(
+  __global const T *x,
+  __global T *output,
+  const uint n,
+  const T lo,
+  const T hi
+)
+{
+  FOR_VECTORS(v, n)
+    VSTORE(clamp(VLOAD(v, x), lo, hi), v, output);
+
+  TAIL_ELEMENT(t, n)
+    output[t] = clamp(x[t], lo, hi);
+}
+
+// EOF
@@ -0,0 +1,87 @@
+/*
+# philox.cl
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Philox4x32-10, bit identical to philox.h on the host (see there for the
+// element -> counter mapping).
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+uint4 Philox4x32(ulong block, uint stream, uint k0, uint k1)
+{
+  uint4 c = (uint4)((uint)block, (uint)(block >> 32), stream, 0);
+
+  for (uint r = 0; r < 10; r++)
+  {
+    if (r > 0)
+    {
+      k0 += PHILOX_W0;
+      k1 += PHILOX_W1;
+    }
+
+    uint hi0 = mul_hi(PHILOX_M0, c.x);
+    uint lo0 = PHILOX_M0 * c.x;
+    uint hi1 = mul_hi(PHILOX_M1, c.z);
+    uint lo1 = PHILOX_M1 * c.z;
+
+    c = (uint4)(hi1 ^ c.y ^ k0, lo1, hi0 ^ c.w ^ k1, lo0);
+  }
+
+  return c;
+}
+
+//
+// Fills output[0, n) with elements first .. first + n - 1 of stream. Each
+// work-item produces one Philox block of 4 elements, so launch
+// ((first + n + 3) / 4 - first / 4) work-items.
+//
+__kernel void PhiloxUniform(
+  __global float *output, // W
+  const ulong first,
+  const uint n,
+  const uint stream,
+  const uint seed_lo,
+  const uint seed_hi
+)
+{
+  ulong block = first / 4 + get_global_id(0);
+
+  uint4 bits = Philox4x32(block, stream, seed_lo, seed_hi);
+  float4 values = convert_float4(bits >> 8) * (1.0f / 16777216.0f);
+
+  long local_index = (long)(block * 4) - (long)first;
+
+  if (local_index >= 0 && local_index + 3 < n)
+  {
+    vstore4(values, 0, output + local_index);
+  }
+  else
+  {
+    float v[4] = {values.x, values.y, values.z, values.w};
+
+    for (int k = 0; k < 4; k++)
+      if (local_index + k >= 0 && local_index + k < n)
+        output[local_index + k] = v[k];
+  }
+}
+
+// EOF
@@ -0,0 +1,134 @@
+/*
+# reduce.cl
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Reductions of a chunk to one partial result per work-group. Each
+// work-item folds a grid-stride slice of the chunk in private memory, then
+// the work-group combines its work-items' values in a tree over scratch
+// (__local, one float per work-item; the work-group size must be a power of
+// two). Work-item 0 writes the group's result to partials[group]; the host
+// combines the partials of all chunks and devices. OclEnv::ReduceRange()
+// sizes the launch.
+//
+//   ReduceSum  sum of in
+//   ReduceMin  smallest element of in
+//   ReduceMax  largest element of in
+//   ReduceDot  sum of a * b
+
+#define ADD(a, b) ((a) + (b))
+
+#define GROUP_REDUCE(NAME, COMBINE)                                     \
+float NAME(float x, __local float *scratch)                             \
+{                                                                       \
+  uint l = get_local_id(0);                                             \
+                                                                        \
+  scratch[l] = x;                                                       \
+  barrier(CLK_LOCAL_MEM_FENCE);                                         \
+                                                                        \
+  for (uint s = get_local_size(0) / 2; s > 0; s >>= 1)                  \
+  {                                                                     \
+    if (l < s)                                                          \
+      scratch[l] = COMBINE(scratch[l], scratch[l + s]);                 \
+    barrier(CLK_LOCAL_MEM_FENCE);                                       \
+  }                                                                     \
+                                                                        \
+  return scratch[0];                                                    \
+}
+
+GROUP_REDUCE(GroupSum, ADD)
+GROUP_REDUCE(GroupMin, fmin)
+GROUP_REDUCE(GroupMax, fmax)
+
+#define FOR_ELEMENTS(i, n) \
+  for (uint i = get_global_id(0); i < (n); i += get_global_size(0))
+
+__kernel void ReduceSum(
+  __global const float *in,  // R
+  __global float *partials,  // W, one per work-group
+  const uint n,              // elements in this chunk
+  __local float *scratch     // one per work-item
+)
+{
+  float x = 0.0f;
+
+  FOR_ELEMENTS(i, n)
+    x += in[i];
+
+  x = GroupSum(x, scratch);
+
+  if (get_local_id(0) == 0)
+    partials[get_group_id(0)] = x;
+}
+
+__kernel void ReduceMin(
+  __global const float *in,
+  __global float *partials,
+  const uint n,
+  __local float *scratch
+)
+{
+  float x = INFINITY;
+
+  FOR_ELEMENTS(i, n)
+    x = fmin(x, in[i]);
+
+  x = GroupMin(x, scratch);
+
+  if (get_local_id(0) == 0)
+    partials[get_group_id(0)] = x;
+}
+
+__kernel void ReduceMax(
+  __global const float *in,
+  __global float *partials,
+  const uint n,
+  __local float *scratch
+)
+{
+  float x = -INFINITY;
+
+  FOR_ELEMENTS(i, n)
+    x = fmax(x, in[i]);
+
+  x = GroupMax(x, scratch);
+
+  if (get_local_id(0) == 0)
+    partials[get_group_id(0)] = x;
+}
+
+__kernel void ReduceDot(
+  __global const float *a,   // R
+  __global const float *b,   // R
+  __global float *partials,  // W, one per work-group
+  const uint n,
+  __local float *scratch
+)
+{
+  float x = 0.0f;
+
+  FOR_ELEMENTS(i, n)
+    x += a[i] * b[i];
+
+  x = GroupSum(x, scratch);
+
+  if (get_local_id(0) == 0)
+    partials[get_group_id(0)] = x;
+}
+
+// EOF
@@ -1,32 +0,0 @@
-/*
-# summer.cl
-#     for learnOpenCL
-#     Copyright (C) 2015 Steve Novakov
-
-#     This program is free software; you can redistribute it and/or modify
-#     it under the terms of the GNU General Public License as published by
-#     the Free Software Foundation; either version 2 of the License, or
-#     (at your option) any later version.
-
-#     This program is distributed in the hope that it will be useful,
-#     but WITHOUT ANY WARRANTY; without even the implied warranty of
-#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-#     GNU General Public License for more details.
-
-#     You should have received a copy of the GNU General Public License along
-#     with this program; if not, write to the Free Software Foundation, Inc.,
-#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
-*/
-
-__kernel void Summer(
-  __global float *set_one, // R
-  __global float *set_two, // R
-  __global float *output   // W
-)
-{
-  uint glid = get_global_id(0);
-
-  output[glid] = set_one[glid] + set_two[glid];
-}
-
-// EOF
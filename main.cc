@@ -22,17 +22,105 @@
 #include <iostream>
 #include <string>
 #include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <type_traits>
 
 #include <CL/cl.hpp>
 #include "oclenv.h"
 #include "customtypes.h"
+#include "hostbackend.h"
+#include "philox.h"
+#include "mappedfile.h"
+#include "kernelregistry.h"
+#include "fusion.h"
+#include "executor.h"
 
 ConfigData config = {
-  100.0,  // output data size (MB)
-  10.0,   // processing chunk size per enqueueNDRangeKernel call (MB)
-  std::vector<uint32_t>() // specific gpus to use, if empty: use all available.
+  100000000, // output data size (B, -datasize=, see ParseSize())
+  0,      // processing chunk size per enqueueNDRangeKernel call (B), if 0:
+          // chosen from the probed devices
+  std::vector<uint32_t>(), // specific gpus to use, if empty: use all available.
+  0,      // buffer sets (pipeline slots) in flight per device, if 0: chosen
+          // from the probed devices
+  CL_DEVICE_TYPE_ALL, // device types (-devicetype=gpu|cpu|accelerator|all)
+  -1,     // platform to use, if negative: all platforms
+  TRANSFER_COPY, // host <-> device path (-transfer=copy|pinned|zerocopy)
+  "",     // kernel binary cache directory, if empty: OclEnv default
+  false,  // print the profile summary (-profile)
+  "",     // Chrome trace-event JSON output file (-trace=)
+  0,      // untimed warmup runs before the measured ones (-warmup=)
+  1,      // measured runs (-repeat=)
+  "",     // CSV file the run statistics are appended to (-results=)
+  false,  // process chunks on the host as well (-hostengine)
+  0,      // host backend threads, if 0: all hardware threads (-hostthreads=)
+  false,  // check every output element against the host backend (-verify)
+  GENERATE_HOST, // where the random inputs are made (-generate=host|device)
+  1,      // Philox seed of the inputs (-seed=)
+  false,  // benchmark the Summer variants and save the best (-autotune)
+  std::vector<std::string>(), // operand files, streamed instead of
+                               // generated (-in1=, -in2=, ...)
+  std::vector<std::string>(), // result files, written as the chunks
+                               // complete (-out= or -out1=, -out2=, ...)
+  "sum",  // element-wise operation to run, see kernelregistry.cc (-op=)
+  std::vector<double>(), // its scalar parameters, empty: defaults (-params=)
+  "",     // operations to fuse into one kernel, replaces -op (-expr=)
+  REDUCE_NONE, // reduce the output to a scalar on the devices (-reduce=)
+  QUEUE_MULTI, // copy and compute queues per device (-queues=single|multi)
+  WIRE_FP32, // element format on the devices and the bus (-wire=fp32|fp16|bf16)
+  false,  // write the first output over the first input (-inplace)
+  TYPE_FLOAT, // element type (-type=float|double|int|long|float3|float4|int3|
+              // int4)
+  LAYOUT_AOS, // vector components on the devices (-layout=aos|soa)
+  3,      // retries of a failed chunk before the run is given up (-retries=)
+  3,      // chunk failures in a row that quarantine a device (-quarantine=)
+  0.0,    // chance that a chunk attempt fails on purpose (-faultrate=)
+  -1      // device the faults are injected on, if negative: all
+          // (-faultdevice=)
 };
 
+uint32_t Passes(const StreamJob & data);
+
+float InputAt(const StreamJob & data, uint32_t stream, uint64_t i);
+
+std::string EntryString(const StreamJob & data, uint64_t i);
+
+template <typename T>
+std::string TypedEntryString(const StreamJob & data, uint64_t i);
+
+template <typename T>
+std::string ValueString(T x);
+
+const float * FloatIn(const StreamJob & data, uint32_t b);
+
+const float * FloatOut(const StreamJob & data, uint32_t b);
+
+VerifyResult VerifyOutput(HostBackend * host, const StreamJob & data,
+  uint64_t n);
+
+bool ReportWireError(HostBackend * host, const StreamJob & data, uint64_t n);
+
+double ReduceExpected(HostBackend * host, const StreamJob & data, uint64_t n,
+  double * magnitude);
+
+std::string TransferModeString(uint32_t mode);
+
+std::string QueueModeString(uint32_t mode);
+
+std::string WireString(uint32_t wire);
+
+std::string LayoutString(uint32_t layout);
+
+std::string ReduceString(uint32_t reduce);
+
+uint32_t ParseType(std::string type);
+
+uint64_t ParseSize(std::string size);
+
 void CLArgs(int argc, char * argv[]);
 
 int main(int argc, char * argv[])
@@ -41,247 +129,490 @@ int main(int argc, char * argv[])
 
   CLArgs(argc, argv);
 
-  // Set up the OpenCL environment and compile the kernels for each device
+  // Set up the OpenCL environment once; the executor keeps it, and the
+  // kernels it builds, for every job submitted to it
 
-  OclEnv env;
-  env.OclInit();
+  StreamingExecutor executor(config);
+  HostBackend & host = *executor.GetHost();
 
-  env.OclDeviceInfo();
+  // the operation to run and its parameters
 
-  env.NewCLCommandQueues();
+  FusedKernel fused;
+  const KernelSignature * op = KernelRegistry::Find(config.op);
 
-  env.CreateKernels();
+  if (!config.expr.empty())
+  {
+    if (!fused.Parse(config.expr))
+      return 1;
 
-  printf("N_GPUs: %lu\n", config.gpu_select.size());
+    op = &fused.Signature();
+    printf("Fused %u operations into %s.\n", fused.HowManyOps(),
+      op->entry.c_str());
+  }
 
-  // might seem superfluous but I'm validating the CLI input here against the
-  // actual environment, so that the code doesn't try to use nonexistent
-  // GPU #10000, etc
-  env.SetGPUs(config.gpu_select);
+  if (op == NULL)
+  {
+    printf("Unknown operation %s.\n", config.op.c_str());
+    KernelRegistry::PrintKernels();
+    return 1;
+  }
 
-  std::vector<uint32_t> gpus = env.GetGPUs();
+  std::vector<double> params = config.params.empty() ? op->param_defaults :
+    config.params;
 
-  printf("OpenCL CommandQueues and Kernels ready.\n");
+  if (params.size() != op->param_names.size())
+  {
+    printf("%s takes %lu parameters, %lu given.\n", op->name.c_str(),
+      op->param_names.size(), params.size());
+    return 1;
+  }
 
-  // Set up I/O containers and fill input.
+  printf("Operation: %s (%s)", op->name.c_str(), op->formula.c_str());
+  for (uint32_t p = 0; p < params.size(); p++)
+    printf("%s%s = %g", p ? ", " : ", with ", op->param_names.at(p).c_str(),
+      params.at(p));
+  printf("\n");
 
-  if (static_cast<uint32_t>(config.data_size / config.chunk_size) < 1)
+  uint32_t n_in = op->n_inputs;
+  uint32_t n_out = op->n_outputs;
+
+  if (REDUCE_NONE != config.reduce)
   {
-    puts("GPU data size must be an integer multiple of the chunk size, \
-      as padding is unsupported.");
-    return 0;
+    if (REDUCE_DOT == config.reduce && n_in < 2)
+    {
+      printf("-reduce=dot needs two inputs, %s has %d.\n", op->name.c_str(),
+        n_in);
+      return 1;
+    }
+
+    if (!config.out_files.empty())
+    {
+      puts("A reduction has no element-wise output to stream to -out.");
+      return 1;
+    }
+
+    printf("Reduction: %s\n", REDUCE_DOT == config.reduce ?
+      "dot (in1 . in2)" : (ReduceString(config.reduce) + " of " + op->name +
+      " output 1").c_str());
   }
 
-  float total_size = config.data_size * gpus.size();
-  // total size of each input array, in MB
-  float chunk_size = config.chunk_size;
-  // size of each chunk summed by a single kernel execution
+  std::vector<uint32_t> gpus = executor.GetGPUs();
 
-  uint32_t n = static_cast<uint32_t>(total_size * 1e6 / sizeof(float));
-  uint32_t n_gpu = static_cast<uint32_t>(config.data_size * 1e6 /
-    sizeof(float));
-  uint32_t n_chunk = static_cast<uint32_t>( chunk_size * 1e6 / sizeof(float));
-  uint32_t n_chunks = n_gpu / n_chunk;
+  // Streamed operands set the data size. Only the chunks in flight, and the
+  // ones being read ahead, are resident.
 
-  printf("Total Input Size: %.3f (MB), GPU Size: %.3f (MB), \
-    Compute Chunk: %.3f (MB), Total Array Size: %d, GPU Array Size: %d\n",
-      total_size, config.data_size, chunk_size, n, n_gpu);
+  std::vector<MappedFile> map_in(n_in), map_out(n_out);
+  bool stream_in = !config.in_files.empty();
+  bool stream_out = !config.out_files.empty();
 
-  std::vector<float> input_one, input_two, output;
+  if (stream_in)
+  {
+    if (config.in_files.size() != n_in)
+    {
+      printf("%s needs %d input files (-in1= ... -in%d=).\n", op->name.c_str(),
+        n_in, n_in);
+      return 1;
+    }
 
-  input_one.resize(n);
-  input_two.resize(n);
-  output.resize(n);
+    for (uint32_t b = 0; b < n_in; b++)
+    {
+      if (config.in_files.at(b).empty())
+      {
+        printf("-in%d= is missing.\n", b + 1);
+        return 1;
+      }
 
-  std::default_random_engine generator;
-  std::uniform_real_distribution<double> distribution(0.0,1.0);
+      if (!map_in.at(b).Open(config.in_files.at(b)))
+        return 1;
 
-  puts("Generating random number sets...\n");
-  for (uint32_t i = 0; i < n; i++)
-  {
-    input_one.at(i) = distribution(generator);
-    input_two.at(i) = distribution(generator);
+      if (map_in.at(b).Size() != map_in.at(0).Size() ||
+        map_in.at(b).Size() % GetElementInfo(config.type).size)
+      {
+        printf("%s and %s must hold the same number of %s elements.\n",
+          config.in_files.at(0).c_str(), config.in_files.at(b).c_str(),
+          GetElementInfo(config.type).name);
+        return 1;
+      }
+    }
+
+    config.data_size = map_in.at(0).Size();
   }
-  puts("Number sets complete.\n");
 
-  uint32_t buffer_mem_size = n_chunk * sizeof(float);
+  if (stream_out && config.out_files.size() != n_out)
+  {
+    printf("%s has %d outputs, as many -out files are needed.\n",
+      op->name.c_str(), n_out);
+    return 1;
+  }
 
-  printf("N Chunks: %d, Chunk Buffer Size: %d (B)\n",
-    n_chunks, buffer_mem_size);
+  // 16 bit transfers: the host arrays stay float, only what crosses the bus
+  // (and sits in the device buffers) is converted
 
-  // OpenCL setup and kernel execution
+  if (WIRE_FP32 != config.wire)
+  {
+    if (op->entry != "Summer" || REDUCE_NONE != config.reduce ||
+      (!stream_in && GENERATE_DEVICE == config.generate_mode))
+    {
+      printf("-wire=%s needs -op=sum, no -reduce and inputs from the host.\n",
+        WireString(config.wire).c_str());
+      return 1;
+    }
 
-  cl_int err;
+    printf("Wire format: %s, unit roundoff %.3g\n",
+      WireString(config.wire).c_str(), HostBackend::WireEpsilon(config.wire));
+  }
 
-  std::vector<cl::Context*> cntxts;
-  std::vector<cl::CommandQueue*> cqs;
-  std::vector<cl::Kernel*> kerns;
+  // In place, output 1 replaces input 1 on the devices and, unless the inputs
+  // are generated there, on the host as well. The overwritten input is
+  // regenerated for verification, so it can not come from a file.
 
-  std::vector<cl::Buffer> ones;
-  std::vector<cl::Buffer> twos;
-  std::vector<cl::Buffer> outs;
+  if (config.in_place)
+  {
+    if (REDUCE_NONE != config.reduce || stream_in || stream_out ||
+      WIRE_FP32 != config.wire)
+    {
+      puts("-inplace can not be combined with -reduce, -in, -out or -wire.");
+      return 1;
+    }
 
-  std::vector< std::vector<cl::Event> > kernel_events_1; // c = 0
-  std::vector< std::vector<cl::Event> > kernel_events_2; // c != 0
-  std::vector< std::vector<cl::Event> > read_events;
+    printf("In place: %s output 1 overwrites input 1\n", op->name.c_str());
+  }
 
-  // For every sub vector of events the order of events is:
-  // 0) write one 1) write two 2) read_out 3) enqueueNDrangeKernel
+  // Other element types than float run on the host and the devices alike;
+  // vector types component by component, as arrays of components. Fused
+  // kernels, the reductions, the wire formats and the device generator are
+  // float only.
 
-  std::vector< std::vector<cl::Event> > * kernel_events = &kernel_events_1;
+  const ElementInfo & type = GetElementInfo(config.type);
+  uint32_t component_size = type.size / type.components;
 
-  for (uint32_t d = 0; d < gpus.size(); d++)
+  if (TYPE_FLOAT != config.type)
   {
-    kernel_events_1.push_back(std::vector<cl::Event>());
-    kernel_events_2.push_back(std::vector<cl::Event>());
+    if (!op->host_double || REDUCE_NONE != config.reduce ||
+      WIRE_FP32 != config.wire || config.in_place ||
+      (!stream_in && GENERATE_DEVICE == config.generate_mode))
+    {
+      printf("-type=%s needs an -op (no -expr), no -reduce, -wire or \
+-inplace and inputs from the host.\n", type.name);
+      return 1;
+    }
 
-    read_events.push_back(std::vector<cl::Event>());
-    read_events.back().push_back(cl::Event());
+    // integer parameters are truncated, they must fit the type, and a long
+    // one a double's 53 bit mantissa
+    bool integer = TYPE_INT == type.component || TYPE_LONG == type.component;
+    double limit = TYPE_INT == type.component ? 2147483647.0 :
+      9007199254740992.0;
 
-    for (uint32_t i = 0; i < 2; i++)
-      kernel_events_1.back().push_back(cl::Event());
-    for (uint32_t i = 0; i < 3; i++)
-      kernel_events_2.back().push_back(cl::Event());
+    for (uint32_t p = 0; integer && p < params.size(); p++)
+    {
+      if (!(std::fabs(params.at(p)) <= limit))
+      {
+        printf("-type=%s takes parameters up to %.0f in magnitude, %s = %g.\n",
+          type.name, limit, op->param_names.at(p).c_str(), params.at(p));
+        return 1;
+      }
+    }
+
+    printf("Element type: %s, %u B, %u %s component(s), %s on the devices\n",
+      type.name, type.size, type.components, type.cl_type,
+      LayoutString(config.layout).c_str());
   }
 
+  if (config.fault_rate > 0)
+  {
+    if (config.fault_device < 0)
+      printf("Injecting faults: %.2f%% of chunk attempts fail\n",
+        100.0 * config.fault_rate);
+    else
+      printf("Injecting faults: %.2f%% of chunk attempts on device %d fail\n",
+        100.0 * config.fault_rate, config.fault_device);
+  }
 
-  for (uint32_t d = 0; d < gpus.size(); d++)
+  if (LAYOUT_SOA == config.layout && type.components == 1)
   {
-    cntxts.push_back(env.GetContext(gpus.at(d)));
-    cqs.push_back(env.GetCq(gpus.at(d)));
-    kerns.push_back(env.GetKernel(gpus.at(d)));
+    printf("-layout=soa needs a vector -type, %s has one component.\n",
+      type.name);
+    return 1;
+  }
 
-    ones.push_back(cl::Buffer(  (*cntxts.back()), // cl::Context &context
-                                CL_MEM_READ_ONLY, // cl_mem_flags
-                                buffer_mem_size, // size_t size
-                                NULL, // void *host_ptr
-                                &err // cl_int *err
-                             ));
-    if (CL_SUCCESS != err)
-      env.Die(err);
+  // Set up I/O containers and fill input.
 
-    // Set up data container OpenCL buffers
+  if (config.data_size == 0 || config.data_size % type.size ||
+    config.chunk_size % type.size)
+  {
+    printf("The data and chunk sizes must be non-zero multiples of %u B \
+(whole %s elements).\n", type.size, type.name);
+    return 1;
+  }
 
-    twos.push_back(cl::Buffer((*cntxts.back()),
-      CL_MEM_READ_ONLY, buffer_mem_size, NULL, &err));
-    if (CL_SUCCESS != err)
-      env.Die(err);
-    outs.push_back(cl::Buffer((*cntxts.back()),
-      CL_MEM_WRITE_ONLY, buffer_mem_size, NULL, &err));
-    if (CL_SUCCESS != err)
-      env.Die(err);
+  // A data size that is not a multiple of the chunk size leaves a shorter
+  // last chunk, nothing is padded. A chunk is at most the whole data set.
+  // Without a chunk size (n_chunk 0) the executor chooses one. Both count
+  // components from here on.
 
-    // Set the kernel arguments
-    kerns.back()->setArg(0, ones.back());
-    kerns.back()->setArg(1, twos.back());
-    kerns.back()->setArg(2, outs.back());
+  uint64_t n = config.data_size / type.size * type.components;
+  uint64_t n_chunk = std::min<uint64_t>(config.chunk_size / type.size *
+    type.components, n);
+  uint64_t n_chunks = n_chunk ? (n + n_chunk - 1) / n_chunk : 0;
 
+  if (n_chunk > UINT32_MAX || n_chunks > UINT32_MAX)
+  {
+    puts("Chunks, and the number of chunks, are limited to 2^32 - 1.");
+    return 1;
   }
 
-  cl::NDRange offset(0);
-  cl::NDRange compute_range(n_chunk);
+  double total_size = config.data_size / 1e6;
+  // total size of each input array, in MB, shared by all devices
+
+  if (n_chunk)
+    printf("Total Input Size: %.3f (MB), Compute Chunk: %.3f (MB), \
+Total Array Size: %llu\n", total_size, n_chunk * component_size / 1e6,
+      static_cast<unsigned long long>(n));
+  else
+    printf("Total Input Size: %.3f (MB), Compute Chunk: auto, \
+Total Array Size: %llu\n", total_size, static_cast<unsigned long long>(n));
+
+  // HostArray is float storage, other types take as many bytes
+  std::vector<HostArray> inputs(n_in), outputs(n_out);
+  uint64_t n_words = n * component_size / sizeof(float);
 
-  // Execute the work sets
+  bool host_in_place = config.in_place && GENERATE_HOST == config.generate_mode;
 
-  for (uint32_t c = 0; c < n_chunks; c++)
+  // reductions keep their outputs on the devices
+  for (uint32_t b = host_in_place ? 1 : 0;
+    REDUCE_NONE == config.reduce && b < n_out; b++)
   {
-    // Write to the input buffers
-    for (uint32_t d = 0; d < gpus.size(); d++)
+    if (stream_out)
     {
-      err = cqs.at(d)->enqueueWriteBuffer(
-        ones.at(d), // address of relevant cl::Buffer
-        CL_FALSE, // non blocking
-        static_cast<uint32_t>(0), // offset (bytes)
-        buffer_mem_size, // total write size (bytes)
-        &input_one.at(d * n_gpu + c * n_chunk), // pointer to root of data array
-        NULL, // no events to wait on
-        &kernel_events->at(d).at(0) // output event info
-      );
-      if (CL_SUCCESS != err)
-        env.Die(err);
-
-      err = cqs.at(d)->enqueueWriteBuffer(
-        twos.at(d), // address of relevant cl::Buffer
-        CL_FALSE, // non blocking
-        static_cast<uint32_t>(0), // offset (bytes)
-        buffer_mem_size, // total write size (bytes)
-        &input_two.at(d * n_gpu + c * n_chunk), // pointer to root of data array
-        NULL, // no events to wait on
-        &kernel_events->at(d).at(1) // output event info
-      );
-      if (CL_SUCCESS != err)
-        env.Die(err);
-
-      cqs.at(d)->flush();
-    }
-
-    // execute the kernel
-    for (uint32_t d = 0; d < gpus.size(); d++)
+      if (!map_out.at(b).Create(config.out_files.at(b), n * component_size))
+        return 1;
+      printf("Streaming output %d to %s\n", b, config.out_files.at(b).c_str());
+    }
+    else
     {
-      err = cqs.at(d)->enqueueNDRangeKernel(
-        (*kerns.at(d)), // address of kernel
-        offset, // starting global index
-        compute_range, // ending global index
-        cl::NullRange, // work items / work group (just 1)
-        &kernel_events->at(d), // wait on these to be valid to execute
-        &read_events.at(d).at(0) // output event info
-      );
+      outputs.at(b).resize(n_words);
+    }
+  }
 
-      if (CL_SUCCESS != err)
-        env.Die(err);
+  // Inputs are read from files, or are Philox streams 0, 1, ... Generated on
+  // the host they are filled in here, in parallel; generated on the devices
+  // they never exist on the host at all and are recomputed from (seed, index)
+  // wherever needed.
 
-      cqs.at(d)->flush();
+  if (stream_in)
+  {
+    for (uint32_t b = 0; b < n_in; b++)
+      printf("Streaming input %d from %s\n", b, config.in_files.at(b).c_str());
+  }
+  else if (GENERATE_HOST == config.generate_mode)
+  {
+    puts("Generating random number sets...\n");
+    for (uint32_t b = 0; b < n_in; b++)
+    {
+      inputs.at(b).resize(n_words);
+      host.Generate(type.component, inputs.at(b).data(), 0, n, b,
+        config.seed);
     }
+    puts("Number sets complete.\n");
+  }
+  else
+  {
+    puts("Random number sets will be generated on the devices.\n");
+  }
 
-    // so that all subsequent enqueueNDRange calls wait on the read to finish
-    if (c==0)
-      kernel_events = &kernel_events_2;
+  StreamJob job;
 
-    // read back the data
-    for (uint32_t d = 0; d < gpus.size(); d++)
-    {
-      err = cqs.at(d)->enqueueReadBuffer(
-        outs.at(d), // address of relevant cl::Buffer
-        CL_FALSE, // execute and blocking
-        static_cast<uint32_t>(0), // offset (bytes)
-        buffer_mem_size, // total write size (bytes)
-        &output.at(d * n_gpu + c * n_chunk), // pointer to root of data array
-        &read_events.at(d), // wait until kernel finishes to execute
-        &kernel_events->at(d).at(2) // no events to link to for status updates
-      );
+  job.op = op;
+  job.params = params;
+  job.n = n;
+  job.n_chunk = n_chunk;
+  job.type = type.component;
+  job.components = type.components;
+  job.layout = config.layout;
+  job.generate = !stream_in && GENERATE_DEVICE == config.generate_mode;
+  job.seed = config.seed;
+  job.reduce = config.reduce;
+  job.wire = config.wire;
+  job.in_place = config.in_place;
 
-      if (CL_SUCCESS != err)
-        env.Die(err);
+  for (uint32_t b = 0; !job.generate && b < n_in; b++)
+    job.in.push_back(stream_in ? map_in.at(b).Data() : inputs.at(b).data());
 
-      cqs.at(d)->flush();
-    }
+  for (uint32_t b = 0; REDUCE_NONE == config.reduce && b < n_out; b++)
+    job.out.push_back(stream_out ? map_out.at(b).Data() :
+      host_in_place && b == 0 ? inputs.at(0).data() : outputs.at(b).data());
+
+  for (uint32_t b = 0; stream_in && b < n_in; b++)
+    job.map_in.push_back(&map_in.at(b));
+  for (uint32_t b = 0; stream_out && b < n_out; b++)
+    job.map_out.push_back(&map_out.at(b));
+
+  // runs warmup + repeat passes over the data on the dispatcher thread
+
+  JobResult result = executor.Submit(job).get();
+
+  if (!result.completed)
+  {
+    puts("FAILED: the job was given up, see the chunk failures above.");
+    return 1;
   }
 
-  // make sure the last reads are done
-  for (uint32_t d = 0; d < gpus.size(); d++)
+  std::vector<double> run_times = result.run_times;
+  double moved = result.moved;
+  uint32_t depth = result.depth;
+  double chunk_size = static_cast<double>(result.n_chunk) * component_size /
+    1e6;
+  // size of each chunk processed by a single kernel execution
+
+  // median and 95th percentile (nearest rank) of the measured runs
+
+  std::sort(run_times.begin(), run_times.end());
+
+  uint32_t n_times = run_times.size();
+  double median = (n_times % 2) ? run_times.at(n_times / 2) :
+    0.5 * (run_times.at(n_times / 2 - 1) + run_times.at(n_times / 2));
+  double p95 = run_times.at(
+    static_cast<uint32_t>(std::ceil(0.95 * n_times)) - 1);
+
+  printf("Pipeline Depth: %d, Transfer: %s, Queues: %s, Wire: %s, Type: %s, \
+Runs: %d, Median: %.4f (s) %.3f (GB/s), P95: %.4f (s) %.3f (GB/s)\n", depth,
+    TransferModeString(config.transfer_mode).c_str(),
+    QueueModeString(config.queue_mode).c_str(),
+    WireString(config.wire).c_str(), type.name, n_times, median,
+    moved / median / 1e9, p95, moved / p95 / 1e9);
+
+  if (!config.results_file.empty())
   {
-    err = cl::Event::waitForEvents(kernel_events->at(d));
-    if (CL_SUCCESS != err)
-          env.Die(err);
+    std::string op_name = op->name;
+    if (REDUCE_NONE != config.reduce)
+      op_name = ReduceString(config.reduce) + "(" + op_name + ")";
+
+    std::string device_list;
+    for (uint32_t d = 0; d < gpus.size(); d++)
+      device_list += (d ? ";" : "") + std::to_string(gpus.at(d));
+
+    // header only when starting a new file
+    FILE * results = fopen(config.results_file.c_str(), "r");
+    bool new_file = (results == NULL);
+    if (results != NULL)
+      fclose(results);
+
+    results = fopen(config.results_file.c_str(), "a");
+    if (results == NULL)
+    {
+      printf("Could not open %s\n", config.results_file.c_str());
+      return 1;
+    }
+
+    if (new_file)
+      fprintf(results, "datasize_mb,chunksize_mb,devices,op,transfer,queues,"
+        "wire,type,layout,depth,warmup,repeat,median_s,p95_s,median_gbps,"
+        "p95_gbps\n");
+
+    fprintf(results, "%.3f,%.3f,%s,%s,%s,%s,%s,%s,%s,%d,%d,%d,%.6f,%.6f,\
+%.4f,%.4f\n", total_size, chunk_size, device_list.c_str(), op_name.c_str(),
+      TransferModeString(config.transfer_mode).c_str(),
+      QueueModeString(config.queue_mode).c_str(),
+      WireString(config.wire).c_str(), type.name,
+      LayoutString(config.layout).c_str(), depth, config.warmup, n_times,
+      median, p95, moved / median / 1e9, moved / p95 / 1e9);
+
+    fclose(results);
   }
 
   printf("100.00%% complete\n");
 
+  // reductions: the chunks' results, combined by the executor
+
+  if (REDUCE_NONE != config.reduce)
+  {
+    double total = result.reduced;
+
+    printf("Result: %s = %.9g\n", ReduceString(config.reduce).c_str(), total);
+
+    if (config.verify)
+    {
+      printf("Verifying the %s of all %llu entries (%s, %d threads)...\n",
+        ReduceString(config.reduce).c_str(), static_cast<unsigned long long>(n),
+        host.IsaString().c_str(), host.HowManyThreads());
+
+      std::chrono::high_resolution_clock::time_point t_verify =
+        std::chrono::high_resolution_clock::now();
+
+      double magnitude;
+      double expected = ReduceExpected(&host, job, n, &magnitude);
+
+      double verify_time = std::chrono::duration<double>(
+        std::chrono::high_resolution_clock::now() - t_verify).count();
+
+      // min and max are exact, sums are accumulated in float on the devices
+      // in a different order than on the host
+      double tolerance = 1e-4 * magnitude;
+
+      if (std::fabs(total - expected) > tolerance)
+      {
+        printf("FAILED: expected %.9g, difference %.3g exceeds %.3g (%.3f s)\n",
+          expected, total - expected, tolerance, verify_time);
+        return 1;
+      }
+
+      printf("Result correct, expected %.9g (%.3f s)\n", expected,
+        verify_time);
+    }
+
+    return 0;
+  }
+
   // random tests of correctness
 
   uint32_t n_tests = 20;
 
   printf("Testing %d random entries for correctness...\n", n_tests);
 
-  std::uniform_int_distribution<uint32_t> int_distro(0, n);
+  std::default_random_engine generator;
+  std::uniform_int_distribution<uint64_t> int_distro(0, n - 1);
 
   for (uint32_t i = 0; i < n_tests; i++)
   {
-    uint32_t entry = int_distro(generator);
+    uint64_t entry = int_distro(generator);
 
-    printf("Entry %d -> %.4f + %.4f = %.4f ? %.4f\n", entry,
-      input_one.at(entry), input_two.at(entry), output.at(entry),
-        input_one.at(entry) + input_two.at(entry));
+    printf("Entry %llu -> %s\n", static_cast<unsigned long long>(entry),
+      EntryString(job, entry).c_str());
+  }
+
+  // reduced precision transfers are checked against their error bound, over
+  // everything with -verify, else over the first 2^20 entries
+
+  if (WIRE_FP32 != config.wire)
+    return ReportWireError(&host, job, config.verify ? n :
+      std::min<uint64_t>(n, 1 << 20)) ? 0 : 1;
+
+  if (config.verify)
+  {
+    printf("Verifying all %llu entries (%s, %d threads)...\n",
+      static_cast<unsigned long long>(n), host.IsaString().c_str(),
+      host.HowManyThreads());
+
+    std::chrono::high_resolution_clock::time_point t_verify =
+      std::chrono::high_resolution_clock::now();
+
+    VerifyResult result = VerifyOutput(&host, job, n);
+
+    double verify_time = std::chrono::duration<double>(
+      std::chrono::high_resolution_clock::now() - t_verify).count();
+
+    if (result.mismatches > 0)
+    {
+      uint64_t b = result.first_bad;
+
+      printf("FAILED: %llu mismatches, first at entry %llu -> %s (%.3f s)\n",
+        static_cast<unsigned long long>(result.mismatches),
+        static_cast<unsigned long long>(b), EntryString(job, b).c_str(),
+        verify_time);
+      return 1;
+    }
+
+    printf("All entries correct (%.3f s)\n", verify_time);
   }
 
   // cleanup
@@ -289,25 +620,665 @@ int main(int argc, char * argv[])
   return 0;
 }
 
+//
+// In place over host inputs, every pass (warmup runs included) overwrote
+// input 1 with output 1, and the next pass started from there. So the
+// expected outputs are the operation applied once per pass, each time to the
+// previous output 1.
+//
+uint32_t Passes(const StreamJob & data)
+{
+  return data.in_place && !data.generate ? config.warmup + config.repeat : 1;
+}
+
+//
+// Element i of input stream, from the host arrays or regenerated. An input
+// overwritten in place is regenerated as it was before the first pass.
+//
+float InputAt(const StreamJob & data, uint32_t stream, uint64_t i)
+{
+  if (data.generate || (data.in_place && stream == 0))
+    return PhiloxElement(i, stream, data.seed);
+
+  return FloatIn(data, stream)[i];
+}
+
+//
+// "(inputs) -> outputs ? expected outputs" of entry i, for reports
+//
+std::string EntryString(const StreamJob & data, uint64_t i)
+{
+  if (TYPE_DOUBLE == data.type)
+    return TypedEntryString<double>(data, i);
+  else if (TYPE_INT == data.type)
+    return TypedEntryString<int32_t>(data, i);
+  else if (TYPE_LONG == data.type)
+    return TypedEntryString<int64_t>(data, i);
+
+  uint32_t n_in = data.op->n_inputs;
+  uint32_t n_out = data.op->n_outputs;
+
+  std::vector<float> in_values(n_in), expected(n_out);
+  std::vector<float> params(data.params.size());
+  std::vector<const float *> in(n_in);
+  std::vector<float *> out(n_out);
+
+  for (uint32_t p = 0; p < params.size(); p++)
+    params.at(p) = ParamAs<float>(data.params.at(p));
+
+  for (uint32_t b = 0; b < n_in; b++)
+  {
+    in_values.at(b) = InputAt(data, b, i);
+    in.at(b) = &in_values.at(b);
+  }
+  for (uint32_t b = 0; b < n_out; b++)
+    out.at(b) = &expected.at(b);
+
+  for (uint32_t pass = 0; pass < Passes(data); pass++)
+  {
+    data.op->host(in.data(), out.data(), params.data(), 0, 1);
+    in.at(0) = out.at(0);
+  }
+
+  char value[32];
+  std::string entry = data.op->name + "(";
+
+  for (uint32_t b = 0; b < n_in; b++)
+  {
+    snprintf(value, sizeof(value), "%s%.4f", b ? ", " : "", in_values.at(b));
+    entry += value;
+  }
+  entry += ") =";
+
+  for (uint32_t b = 0; b < n_out; b++)
+  {
+    snprintf(value, sizeof(value), " %.4f", FloatOut(data, b)[i]);
+    entry += value;
+  }
+  entry += " ?";
+
+  for (uint32_t b = 0; b < n_out; b++)
+  {
+    snprintf(value, sizeof(value), " %.4f", expected.at(b));
+    entry += value;
+  }
+
+  return entry;
+}
+
+//
+// EntryString() over other element types than float, whose inputs always
+// come from the host arrays
+//
+template <typename T>
+std::string TypedEntryString(const StreamJob & data, uint64_t i)
+{
+  uint32_t n_in = data.op->n_inputs;
+  uint32_t n_out = data.op->n_outputs;
+
+  std::vector<T> in_values(n_in), expected(n_out);
+  std::vector<T> params(data.params.size());
+  std::vector<const T *> in(n_in);
+  std::vector<T *> out(n_out);
+
+  for (uint32_t p = 0; p < params.size(); p++)
+    params.at(p) = ParamAs<T>(data.params.at(p));
+
+  for (uint32_t b = 0; b < n_in; b++)
+  {
+    in_values.at(b) = static_cast<const T*>(data.in.at(b))[i];
+    in.at(b) = &in_values.at(b);
+  }
+  for (uint32_t b = 0; b < n_out; b++)
+    out.at(b) = &expected.at(b);
+
+  HostReference<T>(*data.op)(in.data(), out.data(), params.data(), 0, 1);
+
+  std::string entry = data.op->name + "(";
+
+  for (uint32_t b = 0; b < n_in; b++)
+    entry += (b ? ", " : "") + ValueString(in_values.at(b));
+  entry += ") =";
+
+  for (uint32_t b = 0; b < n_out; b++)
+    entry += " " + ValueString(static_cast<const T*>(data.out.at(b))[i]);
+  entry += " ?";
+
+  for (uint32_t b = 0; b < n_out; b++)
+    entry += " " + ValueString(expected.at(b));
+
+  return entry;
+}
+
+//
+// A value for reports, integers in full, the rest to 9 significant digits
+//
+template <typename T>
+std::string ValueString(T x)
+{
+  char value[32];
+
+  if (std::is_integral<T>::value)
+    snprintf(value, sizeof(value), "%lld", static_cast<long long>(x));
+  else
+    snprintf(value, sizeof(value), "%.9g", static_cast<double>(x));
+
+  return value;
+}
+
+//
+// The arrays of a job over floats
+//
+const float * FloatIn(const StreamJob & data, uint32_t b)
+{
+  return static_cast<const float*>(data.in.at(b));
+}
+
+const float * FloatOut(const StreamJob & data, uint32_t b)
+{
+  return static_cast<const float*>(data.out.at(b));
+}
+
+//
+// Checks every output over [0, n) against the host backend, a block at a
+// time: the inputs (regenerated if they were made on the devices, or
+// overwritten in place) go through the operation's host reference, once per
+// pass, and the results are compared bit for bit. So verification never
+// needs full size input or reference arrays in memory.
+//
+VerifyResult VerifyOutput(HostBackend * host, const StreamJob & data,
+  uint64_t n)
+{
+  uint32_t n_in = data.op->n_inputs;
+  uint32_t n_out = data.op->n_outputs;
+
+  // the SIMD sum check needs no reference array
+  if (!data.generate && !data.in_place && data.op->entry == "Summer")
+    return host->Verify(data.type, data.in.at(0), data.in.at(1),
+      data.out.at(0), n);
+
+  VerifyResult result = {0, 0};
+
+  // HostArray is float storage, other types take as many bytes
+  uint32_t size = GetElementInfo(data.type).size;
+  uint64_t block = std::min<uint64_t>(n, 1 << 24);
+  uint64_t block_words = block * size / sizeof(float);
+  std::vector<HostArray> generated(data.generate ? n_in :
+    data.in_place ? 1 : 0, HostArray(block));
+  std::vector<HostArray> expected(n_out, HostArray(block_words));
+
+  std::vector<const void *> in(n_in);
+  std::vector<void *> out(n_out);
+
+  for (uint32_t b = 0; b < n_out; b++)
+    out.at(b) = expected.at(b).data();
+
+  for (uint64_t begin = 0; begin < n; begin += block)
+  {
+    uint64_t length = std::min(block, n - begin);
+
+    for (uint32_t b = 0; b < n_in; b++)
+    {
+      if (data.generate || (data.in_place && b == 0))
+      {
+        host->Generate(generated.at(b).data(), begin, length, b, data.seed);
+        in.at(b) = generated.at(b).data();
+      }
+      else
+      {
+        in.at(b) = static_cast<const char*>(data.in.at(b)) + begin * size;
+      }
+    }
+
+    for (uint32_t pass = 0; pass < Passes(data); pass++)
+    {
+      host->Run(data.type, *data.op, in.data(), out.data(),
+        data.params.data(), length);
+      in.at(0) = out.at(0);
+    }
+
+    for (uint32_t b = 0; b < n_out; b++)
+    {
+      VerifyResult part = host->Compare(data.type, expected.at(b).data(),
+        static_cast<const char*>(data.out.at(b)) + begin * size, length);
+
+      if (part.mismatches > 0 &&
+        (result.mismatches == 0 || begin + part.first_bad < result.first_bad))
+        result.first_bad = begin + part.first_bad;
+      result.mismatches += part.mismatches;
+    }
+  }
+
+  return result;
+}
+
+//
+// Error of a 16 bit wire format sum over [0, n) against the exact sum of the
+// float inputs, and whether every entry is within the bound of
+// HostBackend::VerifyWire().
+//
+bool ReportWireError(HostBackend * host, const StreamJob & data, uint64_t n)
+{
+  printf("Checking the %s error bound of %llu entries (%s, %d threads)...\n",
+    WireString(data.wire).c_str(), static_cast<unsigned long long>(n),
+    host->IsaString().c_str(), host->HowManyThreads());
+
+  WireResult result = host->VerifyWire(data.wire, FloatIn(data, 0),
+    FloatIn(data, 1), FloatOut(data, 0), n);
+
+  printf("Max abs error %.3g, max rel error %.3g, worst entry at %.1f%% of \
+its bound\n", result.max_abs, result.max_rel, 100.0 * result.max_bound);
+
+  if (result.over_bound > 0)
+  {
+    uint64_t b = result.first_bad;
+
+    printf("FAILED: %llu entries exceed the error bound, first at entry %llu \
+-> %s\n", static_cast<unsigned long long>(result.over_bound),
+      static_cast<unsigned long long>(b), EntryString(data, b).c_str());
+    return false;
+  }
+
+  puts("All checked entries within the error bound");
+
+  return true;
+}
+
+//
+// The reduction of [0, n) on the host, block by block like VerifyOutput(),
+// accumulated in double. magnitude is the sum of the absolute values that
+// were added (0 for min and max), which bounds the rounding error of the
+// devices' float sums.
+//
+double ReduceExpected(HostBackend * host, const StreamJob & data, uint64_t n,
+  double * magnitude)
+{
+  uint32_t n_in = data.op->n_inputs;
+  uint32_t n_out = data.op->n_outputs;
+
+  uint64_t block = std::min<uint64_t>(n, 1 << 24);
+  std::vector<HostArray> generated(data.generate ? n_in : 0, HostArray(block));
+  std::vector<HostArray> expected(REDUCE_DOT == data.reduce ? 0 : n_out,
+    HostArray(block));
+
+  std::vector<const float *> in(n_in);
+  std::vector<float *> out(expected.size());
+
+  for (uint32_t b = 0; b < expected.size(); b++)
+    out.at(b) = expected.at(b).data();
+
+  double x = HostBackend::ReduceIdentity(data.reduce);
+  *magnitude = 0;
+
+  for (uint64_t begin = 0; begin < n; begin += block)
+  {
+    uint64_t length = std::min(block, n - begin);
+
+    for (uint32_t b = 0; b < n_in; b++)
+    {
+      if (data.generate)
+      {
+        host->Generate(generated.at(b).data(), begin, length, b, data.seed);
+        in.at(b) = generated.at(b).data();
+      }
+      else
+      {
+        in.at(b) = FloatIn(data, b) + begin;
+      }
+    }
+
+    const float * one = in.at(0);
+    const float * two = REDUCE_DOT == data.reduce ? in.at(1) : NULL;
+
+    if (REDUCE_DOT != data.reduce)
+    {
+      host->Run(*data.op, in.data(), out.data(), data.params.data(), length);
+      one = out.at(0);
+    }
+
+    x = HostBackend::ReduceCombine(data.reduce, x,
+      host->Reduce(data.reduce, one, two, length));
+
+    if (REDUCE_SUM != data.reduce && REDUCE_DOT != data.reduce)
+      continue;
+
+    for (uint64_t i = 0; i < length; i++)
+      *magnitude += std::fabs(two != NULL ?
+        static_cast<double>(one[i]) * two[i] : one[i]);
+  }
+
+  return x;
+}
+
+std::string TransferModeString(uint32_t mode)
+{
+  if (TRANSFER_PINNED == mode)
+    return "pinned";
+  else if (TRANSFER_ZEROCOPY == mode)
+    return "zerocopy";
+  else
+    return "copy";
+}
+
+std::string QueueModeString(uint32_t mode)
+{
+  return QUEUE_SINGLE == mode ? "single" : "multi";
+}
+
+std::string WireString(uint32_t wire)
+{
+  if (WIRE_FP16 == wire)
+    return "fp16";
+  else if (WIRE_BF16 == wire)
+    return "bf16";
+  else
+    return "fp32";
+}
+
+//
+// ElementType of a -type= name, TYPE_FLOAT if there is none
+//
+uint32_t ParseType(std::string type)
+{
+  for (uint32_t t = 0; t < N_TYPES; t++)
+  {
+    if (type == GetElementInfo(t).name)
+      return t;
+  }
+
+  return TYPE_FLOAT;
+}
+
+std::string LayoutString(uint32_t layout)
+{
+  return LAYOUT_SOA == layout ? "soa" : "aos";
+}
+
+std::string ReduceString(uint32_t reduce)
+{
+  if (REDUCE_SUM == reduce)
+    return "sum";
+  else if (REDUCE_MIN == reduce)
+    return "min";
+  else if (REDUCE_MAX == reduce)
+    return "max";
+  else if (REDUCE_DOT == reduce)
+    return "dot";
+  else
+    return "none";
+}
+
+//
+// Bytes in a -datasize/-chunksize value. A plain number is in MB (10^6 B),
+// otherwise the unit is B, K, M or G (10^3, 10^6, 10^9 B, a trailing B is
+// optional) or Ki, Mi, Gi (2^10, 2^20, 2^30 B). Returns 0 if size can not be
+// parsed.
+//
+uint64_t ParseSize(std::string size)
+{
+  char * end;
+  double value = strtod(size.c_str(), &end);
+
+  if (end == size.c_str())
+    return 0;
+
+  std::string unit(end);
+  double scale = 1e6;
+
+  if (!unit.empty())
+  {
+    if (unit.back() == 'B')
+      unit.pop_back();
+
+    bool binary = (!unit.empty() && unit.back() == 'i');
+    if (binary)
+      unit.pop_back();
+
+    if (unit.empty() && !binary)
+      scale = 1;
+    else if (unit == "K" || unit == "k")
+      scale = binary ? 1024.0 : 1e3;
+    else if (unit == "M")
+      scale = binary ? 1024.0 * 1024 : 1e6;
+    else if (unit == "G")
+      scale = binary ? 1024.0 * 1024 * 1024 : 1e9;
+    else
+      return 0;
+  }
+
+  if (value < 0)
+    return 0;
+
+  return static_cast<uint64_t>(std::llround(value * scale));
+}
+
 void CLArgs(int argc, char * argv[])
 {
   std::vector<std::string> args(argv, argv+argc);
   bool set_datasize = false;
-  bool set_chunksize = false;
+  bool set_chunksize = false; // and not automatic
 
   for (uint32_t i = 0; i < args.size(); i++)
   {
     if (args.at(i).find("-datasize") == 0)
     {
-      config.data_size=std::stof(args.at(i).substr(args.at(i).find('=')+1));
+      config.data_size = ParseSize(args.at(i).substr(args.at(i).find('=')+1));
       set_datasize = true;
     }
     else if (args.at(i).find("-chunksize") == 0)
     {
-      config.chunk_size=std::stof(args.at(i).substr(args.at(i).find('=')+1));
-      set_chunksize = true;
+      std::string size = args.at(i).substr(args.at(i).find('=')+1);
+
+      config.chunk_size = size == "auto" ? 0 : ParseSize(size);
+      set_chunksize = config.chunk_size != 0;
+
+      if (size != "auto" && !set_chunksize)
+        printf("Invalid -chunksize=%s, choosing it automatically.\n",
+          size.c_str());
+    }
+    else if (args.at(i).find("-depth") == 0)
+    {
+      std::string depth = args.at(i).substr(args.at(i).find('=')+1);
+
+      // 0 (auto): chosen from the probed devices
+      config.pipeline_depth = depth == "auto" ? 0 : std::stoul(depth);
+      if (depth != "auto" && config.pipeline_depth < 1)
+        config.pipeline_depth = 1;
+    }
+    else if (args.at(i).find("-devicetype") == 0)
+    {
+      config.device_type = OclEnv::ParseDeviceType(
+        args.at(i).substr(args.at(i).find('=')+1));
+    }
+    else if (args.at(i).find("-platform") == 0)
+    {
+      config.platform = std::stoi(args.at(i).substr(args.at(i).find('=')+1));
+    }
+    else if (args.at(i).find("-transfer") == 0)
+    {
+      std::string mode = args.at(i).substr(args.at(i).find('=')+1);
+
+      if (mode == "pinned")
+        config.transfer_mode = TRANSFER_PINNED;
+      else if (mode == "zerocopy")
+        config.transfer_mode = TRANSFER_ZEROCOPY;
+      else
+        config.transfer_mode = TRANSFER_COPY;
     }
-    else if (args.at(i).find("-gpus") == 0)
+    else if (args.at(i).find("-queues") == 0)
+    {
+      std::string mode = args.at(i).substr(args.at(i).find('=')+1);
+
+      config.queue_mode = mode == "single" ? QUEUE_SINGLE : QUEUE_MULTI;
+    }
+    else if (args.at(i).find("-wire") == 0)
+    {
+      std::string wire = args.at(i).substr(args.at(i).find('=')+1);
+
+      config.wire = WIRE_FP32;
+      for (uint32_t w = WIRE_FP16; w <= WIRE_BF16; w++)
+      {
+        if (wire == WireString(w))
+          config.wire = w;
+      }
+    }
+    else if (args.at(i).find("-type") == 0)
+    {
+      std::string type = args.at(i).substr(args.at(i).find('=')+1);
+
+      config.type = ParseType(type);
+      if (type != GetElementInfo(config.type).name)
+        printf("Unknown -type=%s, using float.\n", type.c_str());
+    }
+    else if (args.at(i).find("-layout") == 0)
+    {
+      std::string layout = args.at(i).substr(args.at(i).find('=')+1);
+
+      config.layout = layout == "soa" ? LAYOUT_SOA : LAYOUT_AOS;
+    }
+    else if (args.at(i).find("-retries") == 0)
+    {
+      config.retries = std::stoul(args.at(i).substr(args.at(i).find('=')+1));
+    }
+    else if (args.at(i).find("-quarantine") == 0)
+    {
+      config.quarantine =
+        std::stoul(args.at(i).substr(args.at(i).find('=')+1));
+      if (config.quarantine < 1)
+        config.quarantine = 1;
+    }
+    else if (args.at(i).find("-faultrate") == 0)
+    {
+      config.fault_rate = std::stod(args.at(i).substr(args.at(i).find('=')+1));
+    }
+    else if (args.at(i).find("-faultdevice") == 0)
+    {
+      config.fault_device =
+        std::stoi(args.at(i).substr(args.at(i).find('=')+1));
+    }
+    else if (args.at(i).find("-kernelcache") == 0)
+    {
+      config.kernel_cache = args.at(i).substr(args.at(i).find('=')+1);
+    }
+    else if (args.at(i).find("-profile") == 0)
+    {
+      config.profile = true;
+    }
+    else if (args.at(i).find("-trace") == 0)
+    {
+      config.trace_file = args.at(i).substr(args.at(i).find('=')+1);
+    }
+    else if (args.at(i).find("-warmup") == 0)
+    {
+      config.warmup = std::stoul(args.at(i).substr(args.at(i).find('=')+1));
+    }
+    else if (args.at(i).find("-repeat") == 0)
+    {
+      config.repeat = std::stoul(args.at(i).substr(args.at(i).find('=')+1));
+      if (config.repeat < 1)
+        config.repeat = 1;
+    }
+    else if (args.at(i).find("-results") == 0)
+    {
+      config.results_file = args.at(i).substr(args.at(i).find('=')+1);
+    }
+    else if (args.at(i).find("-hostengine") == 0)
+    {
+      config.host_engine = true;
+    }
+    else if (args.at(i).find("-hostthreads") == 0)
+    {
+      config.host_threads =
+        std::stoul(args.at(i).substr(args.at(i).find('=')+1));
+    }
+    else if (args.at(i).find("-verify") == 0)
+    {
+      config.verify = true;
+    }
+    else if (args.at(i).find("-generate") == 0)
+    {
+      std::string mode = args.at(i).substr(args.at(i).find('=')+1);
+
+      config.generate_mode =
+        mode == "device" ? GENERATE_DEVICE : GENERATE_HOST;
+    }
+    else if (args.at(i).find("-seed") == 0)
+    {
+      config.seed = std::stoull(args.at(i).substr(args.at(i).find('=')+1));
+    }
+    else if (args.at(i).find("-autotune") == 0)
+    {
+      config.autotune = true;
+    }
+    else if (args.at(i).find("-inplace") == 0)
+    {
+      config.in_place = true;
+    }
+    else if (args.at(i).find("-in") == 0 || args.at(i).find("-out") == 0)
+    {
+      // -in<k>= / -out<k>= is file k (from 1) of that kind, -out= is -out1=
+      bool in = args.at(i).find("-in") == 0;
+      std::vector<std::string> * files = in ? &config.in_files :
+        &config.out_files;
+      size_t prefix = in ? 3 : 4;
+      size_t eq = args.at(i).find('=');
+
+      if (eq == std::string::npos)
+        continue;
+
+      std::string number = args.at(i).substr(prefix, eq - prefix);
+      uint32_t k = number.empty() ? 1 : std::stoul(number);
+
+      if (k == 0)
+        continue;
+
+      if (files->size() < k)
+        files->resize(k);
+      files->at(k - 1) = args.at(i).substr(eq + 1);
+    }
+    else if (args.at(i).find("-reduce") == 0)
+    {
+      std::string reduce = args.at(i).substr(args.at(i).find('=')+1);
+
+      config.reduce = REDUCE_NONE;
+      for (uint32_t r = REDUCE_SUM; r <= REDUCE_DOT; r++)
+      {
+        if (reduce == ReduceString(r))
+          config.reduce = r;
+      }
+    }
+    else if (args.at(i).find("-expr") == 0)
+    {
+      config.expr = args.at(i).substr(args.at(i).find('=')+1);
+    }
+    else if (args.at(i).find("-op") == 0)
+    {
+      config.op = args.at(i).substr(args.at(i).find('=')+1);
+    }
+    else if (args.at(i).find("-params") == 0)
+    {
+      std::string source = args.at(i).substr(args.at(i).find('=')+1);
+      size_t start = 0;
+
+      config.params.clear();
+
+      while (start <= source.length())
+      {
+        size_t pos = source.find(',', start);
+        if (pos == std::string::npos)
+          pos = source.length();
+
+        config.params.push_back(std::stod(source.substr(start, pos - start)));
+        start = pos + 1;
+      }
+    }
+    else if (args.at(i).find("-listops") == 0)
+    {
+      KernelRegistry::PrintKernels();
+      exit(0);
+    }
+    else if (args.at(i).find("-gpus") == 0 ||
+      args.at(i).find("-devices") == 0)
     {
       std::string delim = ",";
       std::string begin = "=";
@@ -332,9 +1303,6 @@ void CLArgs(int argc, char * argv[])
     }
   }
 
-  if (set_datasize && !set_chunksize)
-    config.chunk_size = config.data_size / 2;
-
   if (set_chunksize && !set_datasize)
     config.data_size = config.chunk_size * 2;
 }
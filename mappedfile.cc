@@ -0,0 +1,227 @@
+/*
+# mappedfile.cc
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mappedfile.h"
+
+//*********************************************************************
+//
+// MappedFile Constructors/Destructors
+//
+//*********************************************************************
+//
+// Constructor(s)
+//
+MappedFile::MappedFile() : fd(-1), base(NULL), size(0), writable(false)
+{
+  this->page_size = sysconf(_SC_PAGESIZE);
+}
+
+//
+// Destructor
+//
+MappedFile::~MappedFile()
+{
+  this->Close();
+}
+
+//*********************************************************************
+//
+// MappedFile Open/Close
+//
+//*********************************************************************
+
+bool MappedFile::Open(std::string file_name)
+{
+  this->Close();
+
+  this->fd = open(file_name.c_str(), O_RDONLY);
+  if (this->fd < 0)
+  {
+    printf("Could not open %s: %s\n", file_name.c_str(), strerror(errno));
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(this->fd, &info) != 0)
+  {
+    printf("Could not stat %s: %s\n", file_name.c_str(), strerror(errno));
+    this->Close();
+    return false;
+  }
+
+  this->size = info.st_size;
+  this->writable = false;
+
+  if (!this->Map(file_name, PROT_READ))
+    return false;
+
+  // chunks are claimed in order, so let the kernel read ahead and drop pages
+  // behind as well
+  if (this->size > 0)
+    madvise(this->base, this->size, MADV_SEQUENTIAL);
+
+  return true;
+}
+
+bool MappedFile::Create(std::string file_name, uint64_t size)
+{
+  this->Close();
+
+  this->fd = open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (this->fd < 0)
+  {
+    printf("Could not create %s: %s\n", file_name.c_str(), strerror(errno));
+    return false;
+  }
+
+  if (ftruncate(this->fd, size) != 0)
+  {
+    printf("Could not resize %s: %s\n", file_name.c_str(), strerror(errno));
+    this->Close();
+    return false;
+  }
+
+  this->size = size;
+  this->writable = true;
+
+  return this->Map(file_name, PROT_READ | PROT_WRITE);
+}
+
+bool MappedFile::Map(std::string file_name, int prot)
+{
+  if (this->size == 0)
+    return true;
+
+  void * address = mmap(NULL, this->size, prot, MAP_SHARED, this->fd, 0);
+
+  if (address == MAP_FAILED)
+  {
+    printf("Could not map %s: %s\n", file_name.c_str(), strerror(errno));
+    this->Close();
+    return false;
+  }
+
+  this->base = static_cast<char*>(address);
+
+  return true;
+}
+
+//
+// Output files are synced before unmapping, so the results are on disk once
+// the program exits.
+//
+void MappedFile::Close()
+{
+  if (this->base != NULL)
+  {
+    if (this->writable)
+      msync(this->base, this->size, MS_SYNC);
+
+    munmap(this->base, this->size);
+    this->base = NULL;
+  }
+
+  if (this->fd >= 0)
+  {
+    close(this->fd);
+    this->fd = -1;
+  }
+
+  this->size = 0;
+}
+
+float * MappedFile::Data()
+{
+  return reinterpret_cast<float*>(this->base);
+}
+
+uint64_t MappedFile::Size()
+{
+  return this->size;
+}
+
+//*********************************************************************
+//
+// MappedFile Residency
+//
+//*********************************************************************
+
+void MappedFile::Prefetch(uint64_t offset, uint64_t length)
+{
+  if (this->base == NULL || this->writable || offset >= this->size)
+    return;
+
+  length = std::min(length, this->size - offset);
+
+  // madvise wants a page aligned start
+  uint64_t begin = offset / this->page_size * this->page_size;
+
+  madvise(this->base + begin, offset + length - begin, MADV_WILLNEED);
+}
+
+//
+// Only the pages lying entirely inside the range are dropped, the ones it
+// shares with neighbouring chunks may still be in use.
+//
+void MappedFile::Release(uint64_t offset, uint64_t length)
+{
+  if (this->base == NULL || offset >= this->size)
+    return;
+
+  length = std::min(length, this->size - offset);
+
+  uint64_t begin = (offset + this->page_size - 1) / this->page_size *
+    this->page_size;
+  uint64_t end = (offset + length) / this->page_size * this->page_size;
+
+  if (offset + length == this->size)
+    end = this->size;
+
+  if (end <= begin)
+    return;
+
+  if (this->writable)
+  {
+    // start writing the results back now rather than all at the end; the
+    // dirty pages stay in the page cache, so unmapping them loses nothing
+#ifdef SYNC_FILE_RANGE_WRITE
+    sync_file_range(this->fd, begin, end - begin, SYNC_FILE_RANGE_WRITE);
+#else
+    msync(this->base + begin, end - begin, MS_ASYNC);
+#endif
+    madvise(this->base + begin, end - begin, MADV_DONTNEED);
+  }
+  else
+  {
+    madvise(this->base + begin, end - begin, MADV_DONTNEED);
+    posix_fadvise(this->fd, begin, end - begin, POSIX_FADV_DONTNEED);
+  }
+}
+
+//EOF
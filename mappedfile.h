@@ -0,0 +1,78 @@
+/*
+# mappedfile.h
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef  OCLPTX_MAPPEDFILE_H_
+#define  OCLPTX_MAPPEDFILE_H_
+
+#include <cstdint>
+#include <string>
+
+//
+// A float array file mapped into memory, for streaming data sets larger than
+// host RAM through the chunk pipeline. Pages are faulted in on demand;
+// Prefetch() asks the kernel to read a range ahead of use and Release() drops
+// a range that is no longer needed (starting writeback first for an output
+// file), so only the chunks in flight stay resident.
+//
+
+class MappedFile{
+
+  public:
+
+    MappedFile();
+
+    ~MappedFile();
+
+    // Maps an existing file read only.
+    bool Open(std::string file_name);
+
+    // Creates (or truncates) file_name to size bytes and maps it read/write.
+    bool Create(std::string file_name, uint64_t size);
+
+    void Close();
+
+    float * Data();
+
+    uint64_t Size();
+
+    // byte ranges, need not be page aligned
+
+    void Prefetch(uint64_t offset, uint64_t length);
+
+    void Release(uint64_t offset, uint64_t length);
+
+  private:
+
+    bool Map(std::string file_name, int prot);
+
+    int fd;
+
+    char * base;
+
+    uint64_t size;
+
+    bool writable;
+
+    uint64_t page_size;
+};
+
+#endif
+
+//EOF
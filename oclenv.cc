@@ -23,6 +23,12 @@
 #include <vector>
 #include <cmath>
 #include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <CL/cl.hpp>
 
@@ -34,6 +40,53 @@
   static const std::string slash="/";
 #endif
 
+struct EmbeddedKernel
+{
+  const char * name;
+  const char * source;
+};
+
+// { "elementwise.cl", "<contents of kernels/elementwise.cl>" }, ... generated
+// by make
+static const EmbeddedKernel embedded_kernels[] =
+{
+#include "kernelsources.h"
+};
+
+//
+// 64 bit FNV-1a, used for binary cache keys and generated kernel names.
+// Stable across runs and compilers, unlike std::hash.
+//
+uint64_t OclEnv::HashFNV1a(const std::string & data)
+{
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (uint32_t i = 0; i < data.length(); i++)
+  {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+//
+// mkdir -p
+//
+static bool MakeDirs(const std::string & path)
+{
+  for (size_t pos = path.find(slash, 1); ; pos = path.find(slash, pos + 1))
+  {
+    std::string partial = path.substr(0, pos);
+
+    if (mkdir(partial.c_str(), 0755) != 0 && errno != EEXIST)
+      return false;
+
+    if (pos == std::string::npos)
+      return true;
+  }
+}
+
 //*********************************************************************
 //
 // OclEnv Constructors/Destructors
@@ -42,12 +95,19 @@
 //
 // Constructor(s)
 //
-OclEnv::OclEnv(){}
+OclEnv::OclEnv() : kernel_op(NULL), kernel_type(TYPE_FLOAT)
+{
+  this->cache_dir = DefaultCacheDir();
+}
 
 //
 // Destructor
 //
-OclEnv::~OclEnv(){}
+OclEnv::~OclEnv()
+{
+  for (uint32_t p = 0; p < this->pools.size(); p++)
+    delete this->pools.at(p);
+}
 
 //*********************************************************************
 //
@@ -55,21 +115,63 @@ OclEnv::~OclEnv(){}
 //
 //*********************************************************************
 
+cl::Device * OclEnv::GetDevice(uint32_t device_num)
+{
+  return &(this->ocl_devices.at(device_num));
+}
+
 cl::Context * OclEnv::GetContext(uint32_t device_num)
 {
   return &(this->ocl_contexts.at(device_num));
 }
 
-cl::CommandQueue * OclEnv::GetCq(unsigned int device_num)
+cl::CommandQueue * OclEnv::GetCq(unsigned int device_num, uint32_t role)
 {
+  if (QUEUE_H2D == role && !this->ocl_h2d_queues.empty())
+    return &(this->ocl_h2d_queues.at(device_num));
+  if (QUEUE_D2H == role && !this->ocl_d2h_queues.empty())
+    return &(this->ocl_d2h_queues.at(device_num));
+
   return &(this->ocl_device_queues.at(device_num));
 }
 
+BufferPool * OclEnv::GetPool(uint32_t device_num)
+{
+  if (this->pools.size() < this->ocl_contexts.size())
+    this->pools.resize(this->ocl_contexts.size(), NULL);
+
+  if (this->pools.at(device_num) == NULL)
+    this->pools.at(device_num) = new BufferPool(
+      &this->ocl_contexts.at(device_num), &this->ocl_devices.at(device_num));
+
+  return this->pools.at(device_num);
+}
+
 cl::Kernel * OclEnv::GetKernel(unsigned int kernel_num)
 {
   return &(this->kernel_set.at(kernel_num));
 }
 
+const KernelSignature * OclEnv::GetKernelOp()
+{
+  return this->kernel_op;
+}
+
+uint32_t OclEnv::GetKernelType()
+{
+  return this->kernel_type;
+}
+
+cl::Kernel * OclEnv::GetGenerateKernel(unsigned int device_num)
+{
+  return &(this->generate_set.at(device_num));
+}
+
+cl::Kernel * OclEnv::GetReduceKernel(unsigned int device_num)
+{
+  return &(this->reduce_set.at(device_num));
+}
+
 ConfigData * OclEnv::GetConfigData()
 {
   return &(this->config_data);
@@ -117,9 +219,10 @@ std::vector<uint32_t> OclEnv::GetGPUs()
 //
 // OclInit()
 //
-// Currently ignores all non-GPU devices
+// Collects every device matching device_type on every platform (or only on
+// platform, if it is not negative) and gives each one its own context.
 
-void OclEnv::OclInit()
+void OclEnv::OclInit(cl_device_type device_type, int32_t platform)
 {
   cl::Platform::get(&(this->ocl_platforms));
 
@@ -129,28 +232,48 @@ void OclEnv::OclInit()
     exit(-1);
   }
 
-  cl_context_properties con_prop[3] =
+  if (platform >= static_cast<int32_t>(this->ocl_platforms.size()))
   {
-    CL_CONTEXT_PLATFORM,
-    (cl_context_properties) (this->ocl_platforms[0]) (),
-    0
-  };
+    printf("Platform %d requested, but only %lu platforms found.\n",
+      platform, this->ocl_platforms.size());
+    exit(-1);
+  }
+
+  for (uint32_t p = 0; p < this->ocl_platforms.size(); p++)
+  {
+    if (platform >= 0 && static_cast<uint32_t>(platform) != p)
+      continue;
 
-  this->ocl_platforms.at(0);
+    std::vector<cl::Device> platform_devices;
 
-  this->ocl_contexts.push_back(cl::Context(CL_DEVICE_TYPE_GPU, con_prop));
+    // a platform without matching devices reports CL_DEVICE_NOT_FOUND, which
+    // just means there is nothing to add from it
+    if (CL_SUCCESS !=
+      this->ocl_platforms.at(p).getDevices(device_type, &platform_devices))
+      continue;
 
-  this->ocl_devices.push_back(
-    this->ocl_contexts.back().getInfo<CL_CONTEXT_DEVICES>().at(0));
+    cl_context_properties con_prop[3] =
+    {
+      CL_CONTEXT_PLATFORM,
+      (cl_context_properties) (this->ocl_platforms.at(p)) (),
+      0
+    };
 
-  // 1 context per device
+    // 1 context per device
 
-  for (uint32_t d = 1;
-    d < this->ocl_contexts.back().getInfo<CL_CONTEXT_DEVICES>().size(); d++)
+    for (uint32_t d = 0; d < platform_devices.size(); d++)
+    {
+      this->ocl_contexts.push_back(cl::Context(
+        std::vector<cl::Device>(1, platform_devices.at(d)), con_prop));
+      this->ocl_devices.push_back(platform_devices.at(d));
+      this->device_platforms.push_back(p);
+    }
+  }
+
+  if (0 == this->ocl_devices.size())
   {
-    this->ocl_contexts.push_back(cl::Context(CL_DEVICE_TYPE_GPU, con_prop));
-    this->ocl_devices.push_back(
-      this->ocl_contexts.back().getInfo<CL_CONTEXT_DEVICES>().at(d));
+    printf("No OpenCL devices of the requested type found.\n");
+    exit(-1);
   }
 
   printf("OpenCL Environment Initialized.\n");
@@ -159,30 +282,38 @@ void OclEnv::OclInit()
 void OclEnv::OclDeviceInfo()
 {
   std::string platform_version;
-  this->ocl_platforms[0].getInfo( CL_PLATFORM_VERSION, &platform_version);
-  puts(platform_version.c_str());
+
+  for (uint32_t p = 0; p < this->ocl_platforms.size(); p++)
+  {
+    this->ocl_platforms.at(p).getInfo( CL_PLATFORM_VERSION, &platform_version);
+    printf("Platform %d: %s\n", p, platform_version.c_str());
+  }
 
   std::cout<<"\nLocal OpenCL Devices:\n";
 
   size_t siT[3];
   cl_uint print_int;
   cl_ulong print_ulong;
+  cl_device_type print_type;
   std::string print_string;
 
   std::string device_name;
 
-  for (std::vector<cl::Device>::iterator dit = this->ocl_devices.begin();
-    dit != this->ocl_devices.end(); ++dit)
+  for (uint32_t d = 0; d < this->ocl_devices.size(); d++)
   {
+    std::vector<cl::Device>::iterator dit = this->ocl_devices.begin() + d;
 
     dit->getInfo(CL_DEVICE_NAME, &print_string);
     dit->getInfo(CL_DEVICE_NAME, &device_name);
+    dit->getInfo(CL_DEVICE_TYPE, &print_type);
     dit->getInfo(CL_DEVICE_MAX_COMPUTE_UNITS, &print_int);
     dit->getInfo(CL_DEVICE_MAX_WORK_GROUP_SIZE, &siT);
     dit->getInfo(CL_DEVICE_MAX_WORK_ITEM_SIZES, &siT);
 
-    std::cout<<"\tDEVICE\n";
+    std::cout<<"\tDEVICE " << d << "\n";
     std::cout<<"\tDevice Name: " << print_string << "\n";
+    std::cout<<"\tDevice Type: " << DeviceTypeString(print_type) <<
+      " (Platform " << this->device_platforms.at(d) << ")\n";
     std::cout<<"\tMax Compute Units: " << print_int << "\n";
     std::cout<<"\tMax Work Group Size (x*y*z): " << siT[0] << "\n";
     std::cout<<"\tMax Work Item Sizes (x, y, z): " << siT[0] <<
@@ -213,73 +344,455 @@ size_t OclEnv::GetKernelWorkGroupInfo(uint32_t device)
   return wg_size;
 }
 
-void OclEnv::NewCLCommandQueues()
+void OclEnv::NewCLCommandQueues(bool multi)
 {
   this->ocl_device_queues.clear();
+  this->ocl_h2d_queues.clear();
+  this->ocl_d2h_queues.clear();
+
+  cl_command_queue_properties properties =
+    CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE | CL_QUEUE_PROFILING_ENABLE;
 
   for (uint32_t k = 0; k < this->ocl_devices.size(); k++)
   {
-    std::cout<<"Create CommQueue, Device: "<<k<<"\n";
+    std::cout<<"Create CommQueue"<<(multi ? "s (h2d, compute, d2h)" : "")<<
+      ", Device: "<<k<<"\n";
 
     this->ocl_device_queues.push_back(
       cl::CommandQueue(this->ocl_contexts.at(k), this->ocl_devices.at(k),
-        CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE ||  CL_QUEUE_PROFILING_ENABLE));
+        properties));
+
+    if (!multi)
+      continue;
+
+    this->ocl_h2d_queues.push_back(
+      cl::CommandQueue(this->ocl_contexts.at(k), this->ocl_devices.at(k),
+        properties));
+    this->ocl_d2h_queues.push_back(
+      cl::CommandQueue(this->ocl_contexts.at(k), this->ocl_devices.at(k),
+        properties));
   }
 }
 
-void OclEnv::CreateKernels()
+//
+// Builds op (see kernelregistry.h) and the input generator for every device.
+//
+void OclEnv::CreateKernels(const KernelSignature & op, uint32_t type)
 {
   this->kernel_set.clear();
+  this->generate_set.clear();
 
-  cl_int err;
+  // one element per work-item until SetKernelConfig() says otherwise, a
+  // variant tuned for the previous op or type does not carry over
+  KernelConfig scalar = {1, 1, false, 0};
+  this->kernel_configs.assign(this->ocl_devices.size(), scalar);
 
-  // Read Source
-  std::string fold = "kernels";
+  this->kernel_op = &op;
+  this->kernel_type = type;
 
-  std::string kernel_source = fold + slash + "summer.cl";
-  std::string define_list =  "-I ./oclkernels";
+  std::string k_code = this->KernelSource(op.file) + op.generated;
+  std::string g_code = this->KernelSource("philox.cl");
+
+  for (uint32_t d = 0; d < this->ocl_devices.size(); d++)
+  {
+    cl::Program k_program = this->BuildProgram(d, k_code,
+      this->BuildOptions(this->kernel_configs.at(d)));
+    cl::Program g_program = this->BuildProgram(d, g_code, "");
 
-  std::ifstream k_stream(kernel_source);
-  std::string k_code(  (std::istreambuf_iterator<char>(k_stream) ),
-                            (std::istreambuf_iterator<char>()));
-  //
-  // Build Program files here
   //
-  // CAREFUL : this code assumes every device is identical
+  // Compile Kernels from Program
   //
 
-  cl::Program::Sources k_source(
-    1, std::make_pair(k_code.c_str(), k_code.length()));
+    this->kernel_set.push_back(
+      cl::Kernel(k_program, op.entry.c_str(), NULL));
+    this->generate_set.push_back(
+      cl::Kernel(g_program, "PhiloxUniform", NULL));
+  }
+}
+
+//
+// Builds the entry kernel of kernels/reduce.cl on every device, none if entry
+// is empty.
+//
+void OclEnv::CreateReduceKernels(std::string entry)
+{
+  this->reduce_set.clear();
+
+  if (entry.empty())
+    return;
+
+  std::string r_code = this->KernelSource("reduce.cl");
 
   for (uint32_t d = 0; d < this->ocl_devices.size(); d++)
   {
-    cl::Program k_program(cl::Program(this->ocl_contexts.at(d), k_source));
+    cl::Program r_program = this->BuildProgram(d, r_code, "");
+
+    this->reduce_set.push_back(cl::Kernel(r_program, entry.c_str(), NULL));
+  }
+}
+
+//
+// Build options selecting a kernel variant, see kernels/elementwise.cl
+//
+std::string OclEnv::KernelOptions(const KernelConfig & kernel_config)
+{
+  std::string options = "-DVEC=" + std::to_string(kernel_config.vec) +
+    " -DELEMS=" + std::to_string(kernel_config.elems);
+
+  if (kernel_config.grid_stride)
+    options += " -DGRID_STRIDE";
+
+  return options;
+}
+
+//
+// Parameters are given as double, the kernels take them as their component
+// type, converted as the host references' are (ParamAs(), kernelregistry.h).
+//
+cl_int OclEnv::SetParamArg(cl::Kernel * kernel, cl_uint index, uint32_t type,
+  double param)
+{
+  if (TYPE_DOUBLE == type)
+    return kernel->setArg(index, static_cast<cl_double>(param));
+  else if (TYPE_INT == type)
+    return kernel->setArg(index, static_cast<cl_int>(ParamAs<int32_t>(param)));
+  else if (TYPE_LONG == type)
+    return kernel->setArg(index,
+      static_cast<cl_long>(ParamAs<int64_t>(param)));
+  else
+    return kernel->setArg(index, static_cast<cl_float>(ParamAs<float>(param)));
+}
+
+std::string OclEnv::BuildOptions(const KernelConfig & kernel_config)
+{
+  std::string options = KernelOptions(kernel_config);
+
+  if (TYPE_FLOAT != this->kernel_type)
+    options += std::string(" -DT=") +
+      GetElementInfo(this->kernel_type).cl_type;
+  if (TYPE_INT == this->kernel_type || TYPE_LONG == this->kernel_type)
+    options += " -DT_INTEGER";
+
+  return options;
+}
+
+//
+// Rebuilds device's kernel as the kernel_config variant, unless only the
+// work-group size changed.
+//
+void OclEnv::SetKernelConfig(uint32_t device,
+  const KernelConfig & kernel_config)
+{
+  if (KernelOptions(kernel_config) ==
+    KernelOptions(this->kernel_configs.at(device)))
+  {
+    this->kernel_configs.at(device) = kernel_config;
+    return;
+  }
+
+  cl::Program k_program = this->BuildProgram(device,
+    this->KernelSource(this->kernel_op->file) + this->kernel_op->generated,
+    this->BuildOptions(kernel_config));
+
+  this->kernel_set.at(device) = cl::Kernel(k_program,
+    this->kernel_op->entry.c_str(), NULL);
+  this->kernel_configs.at(device) = kernel_config;
+}
+
+KernelConfig OclEnv::GetKernelConfig(uint32_t device)
+{
+  return this->kernel_configs.at(device);
+}
+
+//
+// KernelRange()
+//
+// NDRange for one element-wise kernel launch over n elements on device. Every
+// work-item does ELEMS vectors, or, grid-striding, the launch is a fixed 4
+// work-groups per compute unit. There are always enough work-items for the
+// n % VEC tail, and the global size is padded to a multiple of the work-group
+// size, which the kernel's bounds checks make harmless.
+//
+void OclEnv::KernelRange(uint32_t device, uint32_t n, cl::NDRange * global,
+  cl::NDRange * local)
+{
+  const KernelConfig & kc = this->kernel_configs.at(device);
+
+  size_t n_vec = n / kc.vec;
+  size_t items;
+
+  if (kc.grid_stride)
+  {
+    size_t wg = kc.local != 0 ? kc.local : this->GetKernelWorkGroupInfo(device);
+    items = std::min(n_vec, 4 * wg *
+      this->ocl_devices.at(device).getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>());
+  }
+  else
+  {
+    items = (n_vec + kc.elems - 1) / kc.elems;
+  }
+
+  items = std::max(items, static_cast<size_t>(std::max(n % kc.vec, 1u)));
+
+  if (kc.local != 0)
+  {
+    items = (items + kc.local - 1) / kc.local * kc.local;
+    *local = cl::NDRange(kc.local);
+  }
+  else
+  {
+    *local = cl::NullRange;
+  }
+
+  *global = cl::NDRange(items);
+}
 
-    err = k_program.build(this->ocl_devices);
+//
+// ReduceRange()
+//
+// Launch of the reduction kernel over n elements on device: work-groups of
+// the largest power of two up to 256 work-items the kernel allows, and at
+// most 4 of them per compute unit, each work-item looping over the rest.
+// Returns the number of work-groups, which is the number of partial results.
+//
+uint32_t OclEnv::ReduceRange(uint32_t device, uint32_t n, uint32_t * local)
+{
+  size_t wg_size;
+  this->reduce_set.at(device).getWorkGroupInfo<size_t>(
+    this->ocl_devices.at(device), CL_KERNEL_WORK_GROUP_SIZE, &wg_size);
+
+  *local = 1;
+  while (*local * 2 <= std::min<size_t>(wg_size, 256))
+    *local *= 2;
+
+  uint32_t groups = (n + *local - 1) / *local;
+
+  return std::max(1u, std::min(groups, 4 *
+    this->ocl_devices.at(device).getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>()));
+}
+
+//
+// Kernel sources are compiled into the executable (see the kernelsources.h
+// rule in the Makefile), so runs do not depend on the working directory.
+//
+std::string OclEnv::KernelSource(std::string file_name)
+{
+  for (uint32_t k = 0;
+    k < sizeof(embedded_kernels) / sizeof(embedded_kernels[0]); k++)
+  {
+    if (file_name == embedded_kernels[k].name)
+      return std::string(embedded_kernels[k].source);
+  }
 
-    if (err != CL_SUCCESS)
+  printf("Kernel source %s was not embedded at build time.\n",
+    file_name.c_str());
+  exit(EXIT_FAILURE);
+}
+
+//
+// BuildProgram()
+//
+// Builds source for the single device in context device. The resulting binary
+// is cached on disk under a key made of the source, the build options, and the
+// device, driver and platform versions, so any change to one of them misses
+// the cache and rebuilds from source. Stale or rejected binaries fall back to
+// a source build as well.
+//
+cl::Program OclEnv::BuildProgram(uint32_t device, const std::string & source,
+  const std::string & options)
+{
+  cl_int err;
+
+  std::vector<cl::Device> build_devices(1, this->ocl_devices.at(device));
+
+  std::string cache_file;
+
+  if (!this->cache_dir.empty())
+  {
+    std::string key = source + '\0' + options + '\0' +
+      this->ocl_devices.at(device).getInfo<CL_DEVICE_NAME>() + '\0' +
+      this->ocl_devices.at(device).getInfo<CL_DEVICE_VERSION>() + '\0' +
+      this->ocl_devices.at(device).getInfo<CL_DRIVER_VERSION>() + '\0' +
+      this->ocl_platforms.at(this->device_platforms.at(device)).getInfo<
+        CL_PLATFORM_VERSION>();
+
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx",
+      static_cast<unsigned long long>(HashFNV1a(key)));
+
+    cache_file = this->cache_dir + slash + hex + ".bin";
+
+    std::ifstream c_stream(cache_file, std::ios::binary);
+    std::string binary(  (std::istreambuf_iterator<char>(c_stream) ),
+                              (std::istreambuf_iterator<char>()));
+
+    if (!binary.empty())
     {
-      std::cout<<"ERROR: " <<
-        " ( " << this->OclErrorStrings(err) << ")\n";
+      cl::Program::Binaries k_binary(
+        1, std::make_pair(binary.data(), binary.length()));
+      std::vector<cl_int> binary_status;
 
-      std::vector<cl::Device>::iterator dit = this->ocl_devices.begin();
+      cl::Program k_program(this->ocl_contexts.at(device), build_devices,
+        k_binary, &binary_status, &err);
 
-      std::cout<<"BUILD OPTIONS: \n" <<
-        k_program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(*dit) <<
-         "\n";
-      std::cout<<"BUILD LOG: \n" <<
-        k_program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(*dit) <<"\n";
+      if (CL_SUCCESS == err &&
+        CL_SUCCESS == k_program.build(build_devices, options.c_str()))
+        return k_program;
 
-      exit(EXIT_FAILURE);
+      printf("Device %d: cached binary rejected, rebuilding from source.\n",
+        device);
+      remove(cache_file.c_str());
     }
+  }
 
   //
-  // Compile Kernels from Program
+  // Build Program files here
+  //
+  // Each context holds exactly one device, so each program is built for just
+  // that device; devices can be of different types and from different
+  // platforms.
   //
 
-    this->kernel_set.push_back(
-      cl::Kernel(k_program, "Summer", NULL));
+  cl::Program::Sources k_source(
+    1, std::make_pair(source.c_str(), source.length()));
+
+  cl::Program k_program(cl::Program(this->ocl_contexts.at(device), k_source));
+
+  err = k_program.build(build_devices, options.c_str());
+
+  if (err != CL_SUCCESS)
+  {
+    std::cout<<"ERROR: " <<
+      " ( " << this->OclErrorStrings(err) << ")\n";
+
+    std::vector<cl::Device>::iterator dit = build_devices.begin();
+
+    std::cout<<"BUILD OPTIONS: \n" <<
+      k_program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(*dit) <<
+       "\n";
+    std::cout<<"BUILD LOG: \n" <<
+      k_program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(*dit) <<"\n";
+
+    exit(EXIT_FAILURE);
+  }
+
+  if (!cache_file.empty())
+    this->SaveBinary(k_program, cache_file);
+
+  return k_program;
+}
+
+//
+// Writes the (single device) binary of program to file_name. Written to a
+// temporary and renamed, so concurrent runs never see a partial binary.
+//
+void OclEnv::SaveBinary(cl::Program & program, std::string file_name)
+{
+  size_t binary_size = 0;
+
+  if (CL_SUCCESS != clGetProgramInfo(program(), CL_PROGRAM_BINARY_SIZES,
+    sizeof(size_t), &binary_size, NULL) || binary_size == 0)
+    return;
+
+  std::vector<unsigned char> binary(binary_size);
+  unsigned char * binary_ptr = binary.data();
+
+  if (CL_SUCCESS != clGetProgramInfo(program(), CL_PROGRAM_BINARIES,
+    sizeof(unsigned char *), &binary_ptr, NULL))
+    return;
+
+  if (!MakeDirs(this->cache_dir))
+    return;
+
+  std::string temp_name = file_name + ".tmp" + std::to_string(getpid());
+  std::ofstream c_stream(temp_name, std::ios::binary);
+  c_stream.write(reinterpret_cast<char*>(binary.data()), binary_size);
+  c_stream.close();
+
+  if (!c_stream || 0 != rename(temp_name.c_str(), file_name.c_str()))
+    remove(temp_name.c_str());
+}
+
+bool OclEnv::LoadKeyedLine(std::string file_name, std::string key,
+  std::string * fields)
+{
+  std::ifstream k_stream(file_name);
+  std::string line;
+
+  while (std::getline(k_stream, line))
+  {
+    size_t tab = line.rfind('\t');
+
+    if (tab != std::string::npos && line.substr(0, tab) == key)
+    {
+      *fields = line.substr(tab + 1);
+      return true;
+    }
   }
+
+  return false;
+}
+
+//
+// Written to a temporary and renamed, like the cached binaries.
+//
+void OclEnv::SaveKeyedLine(std::string file_name, std::string key,
+  std::string fields)
+{
+  std::vector<std::string> lines;
+  std::string line;
+
+  std::ifstream k_in(file_name);
+  while (std::getline(k_in, line))
+  {
+    size_t tab = line.rfind('\t');
+
+    if (tab != std::string::npos && line.substr(0, tab) != key)
+      lines.push_back(line);
+  }
+  k_in.close();
+
+  lines.push_back(key + '\t' + fields);
+
+  std::string temp_name = file_name + ".tmp" + std::to_string(getpid());
+  std::ofstream k_out(temp_name);
+
+  for (uint32_t l = 0; l < lines.size(); l++)
+    k_out << lines.at(l) << '\n';
+  k_out.close();
+
+  if (!k_out || 0 != rename(temp_name.c_str(), file_name.c_str()))
+  {
+    printf("Could not write %s\n", file_name.c_str());
+    remove(temp_name.c_str());
+  }
+}
+
+void OclEnv::SetCacheDir(std::string dir)
+{
+  this->cache_dir = dir;
+}
+
+std::string OclEnv::GetCacheDir()
+{
+  return this->cache_dir;
+}
+
+//
+// Default binary cache location: $XDG_CACHE_HOME/learnOpenCL, or
+// $HOME/.cache/learnOpenCL. Empty (no caching) if neither is set.
+//
+std::string OclEnv::DefaultCacheDir()
+{
+  const char * xdg = getenv("XDG_CACHE_HOME");
+  const char * home = getenv("HOME");
+
+  if (xdg != NULL && xdg[0] != '\0')
+    return std::string(xdg) + slash + "learnOpenCL";
+  else if (home != NULL && home[0] != '\0')
+    return std::string(home) + slash + ".cache" + slash + "learnOpenCL";
+  else
+    return "";
 }
 
 void OclEnv::Die(uint32_t reason, std::string additional)
@@ -290,6 +803,35 @@ void OclEnv::Die(uint32_t reason, std::string additional)
   abort();
 }
 
+//
+// Device type bitfield to a short name, and back (for the CLI).
+//
+std::string OclEnv::DeviceTypeString(cl_device_type device_type)
+{
+  if (device_type & CL_DEVICE_TYPE_GPU)
+    return "GPU";
+  else if (device_type & CL_DEVICE_TYPE_CPU)
+    return "CPU";
+  else if (device_type & CL_DEVICE_TYPE_ACCELERATOR)
+    return "ACCELERATOR";
+  else
+    return "OTHER";
+}
+
+cl_device_type OclEnv::ParseDeviceType(std::string name)
+{
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+  if (name == "gpu")
+    return CL_DEVICE_TYPE_GPU;
+  else if (name == "cpu")
+    return CL_DEVICE_TYPE_CPU;
+  else if (name == "accelerator")
+    return CL_DEVICE_TYPE_ACCELERATOR;
+  else
+    return CL_DEVICE_TYPE_ALL;
+}
+
 //
 // Matches OCL error codes to their meaning.
 //
@@ -365,7 +907,14 @@ std::string OclEnv::OclErrorStrings(cl_int error)
     "CL_INVALID_GLOBAL_WORK_SIZE"
   };
 
-  return cl_error_string[ -1*error];
+  // vendor extensions and event statuses are not in the table
+  const int64_t n_strings = sizeof(cl_error_string) / sizeof(std::string);
+  int64_t index = -static_cast<int64_t>(error);
+
+  if (index < 0 || index >= n_strings || cl_error_string[index].empty())
+    return "CL error " + std::to_string(error);
+
+  return cl_error_string[index];
 }
 
 //EOF
@@ -26,7 +26,16 @@
 
 #include <CL/cl.hpp>
 
+#include "bufferpool.h"
 #include "customtypes.h"
+#include "kernelregistry.h"
+
+enum QueueRole
+{
+  QUEUE_COMPUTE, // kernels, and everything outside the chunk pipeline
+  QUEUE_H2D,     // input writes
+  QUEUE_D2H      // output reads and maps
+};
 
 class OclEnv{
 
@@ -46,8 +55,15 @@ class OclEnv{
     uint32_t HowManyDevices();
     uint32_t HowManyCQ();
 
-    cl::CommandQueue * GetCq(uint32_t device_num);
+    // role is a QueueRole; with single queues every role gets the same one
+    cl::CommandQueue * GetCq(uint32_t device_num,
+      uint32_t role = QUEUE_COMPUTE);
+    BufferPool * GetPool(uint32_t device_num);
     cl::Kernel * GetKernel(uint32_t kernel_num);
+    const KernelSignature * GetKernelOp();
+    uint32_t GetKernelType();
+    cl::Kernel * GetGenerateKernel(uint32_t device_num);
+    cl::Kernel * GetReduceKernel(uint32_t device_num);
 
     ConfigData * GetConfigData();
 
@@ -59,21 +75,76 @@ class OclEnv{
     // OpenCL API Interface/Helper Functions
     //
 
-    void OclInit();
+    void OclInit(cl_device_type device_type = CL_DEVICE_TYPE_ALL,
+      int32_t platform = -1);
 
     void OclDeviceInfo();
 
-    void NewCLCommandQueues();
+    // multi: separate host->device and device->host queues next to the
+    // compute queue, so copies can run on the DMA engines alongside kernels
+    void NewCLCommandQueues(bool multi = false);
+
+    // type: ElementType of the components op works on, see -DT= in
+    // kernels/elementwise.cl
+    void CreateKernels(const KernelSignature & op,
+      uint32_t type = TYPE_FLOAT);
+
+    void CreateReduceKernels(std::string entry);
+
+    std::string KernelSource(std::string file_name);
+
+    cl::Program BuildProgram(uint32_t device, const std::string & source,
+      const std::string & options);
+
+    void SaveBinary(cl::Program & program, std::string file_name);
+
+    // Text files of "<key>\t<fields>" lines, one per key (tuning.txt,
+    // probe.txt). Load finds key's fields, Save replaces or adds its line.
+    static bool LoadKeyedLine(std::string file_name, std::string key,
+      std::string * fields);
 
-    void CreateKernels();
+    static void SaveKeyedLine(std::string file_name, std::string key,
+      std::string fields);
+
+    void SetCacheDir(std::string dir);
+
+    static std::string DefaultCacheDir();
+
+    static uint64_t HashFNV1a(const std::string & data);
 
     std::string OclErrorStrings(cl_int error);
 
+    static std::string DeviceTypeString(cl_device_type device_type);
+
+    static cl_device_type ParseDeviceType(std::string name);
+
     size_t GetKernelWorkGroupInfo(uint32_t device);
 
+    static std::string KernelOptions(const KernelConfig & kernel_config);
+
+    // sets argument index of kernel to a parameter of op, as type (an
+    // ElementType component)
+    static cl_int SetParamArg(cl::Kernel * kernel, cl_uint index,
+      uint32_t type, double param);
+
+    void SetKernelConfig(uint32_t device, const KernelConfig & kernel_config);
+
+    KernelConfig GetKernelConfig(uint32_t device);
+
+    void KernelRange(uint32_t device, uint32_t n, cl::NDRange * global,
+      cl::NDRange * local);
+
+    uint32_t ReduceRange(uint32_t device, uint32_t n, uint32_t * local);
+
+    std::string GetCacheDir();
+
     void Die(uint32_t reason, std::string additional = "");
 
   private:
+
+    // KernelOptions() plus the element type, if not float
+    std::string BuildOptions(const KernelConfig & kernel_config);
+
     //
     // OpenCL Objects
     //
@@ -83,14 +154,43 @@ class OclEnv{
 
     std::vector<cl::Device> ocl_devices;
 
+    std::vector<uint32_t> device_platforms;
+    // index into ocl_platforms for every entry of ocl_devices
+
     std::vector<cl::CommandQueue> ocl_device_queues;
+    // compute queue of each device
+
+    std::vector<cl::CommandQueue> ocl_h2d_queues;
+    std::vector<cl::CommandQueue> ocl_d2h_queues;
+    // copy queues of each device, empty with single queues
+
+    std::vector<BufferPool *> pools;
+    // device memory of each device, created on first use
 
     std::vector<cl::Kernel> kernel_set;
     //Every compiled kernel is stored here.
 
+    const KernelSignature * kernel_op;
+    // the element-wise operation kernel_set holds, per device
+
+    uint32_t kernel_type;
+    // and the ElementType it was built for
+
+    std::vector<cl::Kernel> generate_set;
+    // PhiloxUniform, per device
+
+    std::vector<cl::Kernel> reduce_set;
+    // the ReduceKind kernel of kernels/reduce.cl, per device
+
+    std::vector<KernelConfig> kernel_configs;
+    // how each device's kernel_set entry was specialised
+
     std::vector<uint32_t> desired_gpus;
 
     ConfigData config_data;
+
+    std::string cache_dir;
+    // compiled program binaries, empty: no caching
 };
 
 #endif
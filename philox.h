@@ -0,0 +1,90 @@
+/*
+# philox.h
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef  OCLPTX_PHILOX_H_
+#define  OCLPTX_PHILOX_H_
+
+#include <cstdint>
+
+//
+// Philox4x32-10 counter based generator (Salmon et al., "Parallel Random
+// Numbers: As Easy as 1, 2, 3", SC11), host side. kernels/philox.cl is the
+// device side and must stay bit identical to this file.
+//
+// Element e of stream s under seed k is word e % 4 of
+//   Philox4x32-10(counter = {e / 4 (low), e / 4 (high), s, 0},
+//                 key = {k (low), k (high)})
+// mapped to [0, 1) by keeping its top 24 bits, which is exact in float.
+// Any element can therefore be produced independently of all the others.
+//
+
+static const uint32_t PHILOX_M0 = 0xD2511F53;
+static const uint32_t PHILOX_M1 = 0xCD9E8D57;
+static const uint32_t PHILOX_W0 = 0x9E3779B9;
+static const uint32_t PHILOX_W1 = 0xBB67AE85;
+
+inline void Philox4x32(uint64_t block, uint32_t stream, uint64_t seed,
+  uint32_t out[4])
+{
+  uint32_t c0 = static_cast<uint32_t>(block);
+  uint32_t c1 = static_cast<uint32_t>(block >> 32);
+  uint32_t c2 = stream;
+  uint32_t c3 = 0;
+  uint32_t k0 = static_cast<uint32_t>(seed);
+  uint32_t k1 = static_cast<uint32_t>(seed >> 32);
+
+  for (uint32_t r = 0; r < 10; r++)
+  {
+    if (r > 0)
+    {
+      k0 += PHILOX_W0;
+      k1 += PHILOX_W1;
+    }
+
+    uint64_t p0 = static_cast<uint64_t>(PHILOX_M0) * c0;
+    uint64_t p1 = static_cast<uint64_t>(PHILOX_M1) * c2;
+
+    c0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+    c2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+    c1 = static_cast<uint32_t>(p1);
+    c3 = static_cast<uint32_t>(p0);
+  }
+
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+inline float PhiloxToUniform(uint32_t bits)
+{
+  return (bits >> 8) * (1.0f / 16777216.0f);
+}
+
+inline float PhiloxElement(uint64_t element, uint32_t stream, uint64_t seed)
+{
+  uint32_t words[4];
+  Philox4x32(element / 4, stream, seed, words);
+  return PhiloxToUniform(words[element % 4]);
+}
+
+#endif
+
+//EOF
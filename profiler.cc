@@ -0,0 +1,332 @@
+/*
+# profiler.cc
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <cstdio>
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <CL/cl.hpp>
+
+#include "profiler.h"
+
+typedef std::chrono::high_resolution_clock prof_clock;
+
+//*********************************************************************
+//
+// Profiler Constructors/Destructors
+//
+//*********************************************************************
+//
+// Constructor(s)
+//
+Profiler::Profiler() : enabled(false), origin(prof_clock::now()) {}
+
+//
+// Destructor
+//
+Profiler::~Profiler(){}
+
+void Profiler::Enable(bool enable)
+{
+  this->enabled = enable;
+}
+
+bool Profiler::Enabled()
+{
+  return this->enabled;
+}
+
+const char * Profiler::StageName(uint32_t stage)
+{
+  const char * names[N_STAGES] = {"write", "kernel", "read", "generate"};
+
+  return stage < N_STAGES ? names[stage] : "other";
+}
+
+uint64_t Profiler::HostNs(prof_clock::time_point t)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    t - this->origin).count();
+}
+
+//*********************************************************************
+//
+// Profiler Recording
+//
+//*********************************************************************
+
+void Profiler::RecordEvent(uint32_t device, uint32_t chunk, uint32_t stage,
+  uint64_t bytes, const cl::Event & event)
+{
+  if (!this->enabled)
+    return;
+
+  ProfileRecord record;
+  record.device = device;
+  record.chunk = chunk;
+  record.stage = stage;
+  record.bytes = bytes;
+  record.event = event;
+  record.host_ns = this->HostNs(prof_clock::now());
+  record.queued = record.submit = record.start = record.end = 0;
+
+  std::lock_guard<std::mutex> lock(this->record_mutex);
+  this->records.push_back(record);
+}
+
+void Profiler::RecordSpan(uint32_t device, uint32_t chunk, std::string name,
+  prof_clock::time_point start, prof_clock::time_point end)
+{
+  if (!this->enabled)
+    return;
+
+  HostSpan span = {device, chunk, name, this->HostNs(start),
+    this->HostNs(end)};
+
+  std::lock_guard<std::mutex> lock(this->record_mutex);
+  this->spans.push_back(span);
+}
+
+//*********************************************************************
+//
+// Profiler Reporting
+//
+//*********************************************************************
+
+//
+// Commands of failed chunk attempts (see DeviceWorker) never completed and
+// have no timestamps, their records are dropped.
+//
+cl_int Profiler::Collect()
+{
+  cl_int err;
+  std::vector<ProfileRecord> completed;
+
+  for (uint32_t r = 0; r < this->records.size(); r++)
+  {
+    ProfileRecord * rec = &this->records.at(r);
+    cl_int status =
+      rec->event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>(&err);
+    if (CL_SUCCESS != err)
+      return err;
+    if (status < 0)
+      continue;
+
+    err = rec->event.getProfilingInfo(CL_PROFILING_COMMAND_QUEUED,
+      &rec->queued);
+    if (CL_SUCCESS != err)
+      return err;
+    err = rec->event.getProfilingInfo(CL_PROFILING_COMMAND_SUBMIT,
+      &rec->submit);
+    if (CL_SUCCESS != err)
+      return err;
+    err = rec->event.getProfilingInfo(CL_PROFILING_COMMAND_START,
+      &rec->start);
+    if (CL_SUCCESS != err)
+      return err;
+    err = rec->event.getProfilingInfo(CL_PROFILING_COMMAND_END, &rec->end);
+    if (CL_SUCCESS != err)
+      return err;
+
+    // the event is no longer needed, let the runtime free it
+    rec->event = cl::Event();
+
+    completed.push_back(*rec);
+  }
+
+  this->records.swap(completed);
+
+  return CL_SUCCESS;
+}
+
+//
+// Device timestamps come from each device's own clock. A command is queued
+// just before the host records it, so the smallest (host - queued) difference
+// over a device's commands is the best estimate of the offset between the
+// two clocks.
+//
+std::vector<int64_t> Profiler::ClockOffsets(uint32_t n_devices)
+{
+  std::vector<int64_t> offsets(n_devices,
+    std::numeric_limits<int64_t>::max());
+
+  for (uint32_t r = 0; r < this->records.size(); r++)
+  {
+    const ProfileRecord * rec = &this->records.at(r);
+    int64_t offset = static_cast<int64_t>(rec->host_ns) -
+      static_cast<int64_t>(rec->queued);
+
+    offsets.at(rec->device) = std::min(offsets.at(rec->device), offset);
+  }
+
+  return offsets;
+}
+
+//
+// Chrome trace-event format: one process per device with a thread (lane) per
+// stage, plus a host process with one lane per device for enqueue spans.
+//
+void Profiler::WriteTrace(std::string file_name,
+  std::vector<uint32_t> device_ids)
+{
+  FILE * trace = fopen(file_name.c_str(), "w");
+
+  if (trace == NULL)
+  {
+    printf("Could not open trace file %s\n", file_name.c_str());
+    return;
+  }
+
+  std::vector<int64_t> offsets = this->ClockOffsets(device_ids.size());
+
+  fprintf(trace, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+  fprintf(trace, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, "
+    "\"args\": {\"name\": \"Host\"}}");
+
+  for (uint32_t d = 0; d < device_ids.size(); d++)
+  {
+    fprintf(trace, ",\n{\"name\": \"process_name\", \"ph\": \"M\", "
+      "\"pid\": %u, \"args\": {\"name\": \"Device %u\"}}", d + 1,
+      device_ids.at(d));
+    fprintf(trace, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", "
+      "\"pid\": 0, \"tid\": %u, \"args\": {\"name\": \"Device %u\"}}", d,
+      device_ids.at(d));
+
+    for (uint32_t s = 0; s < N_STAGES; s++)
+      fprintf(trace, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", "
+        "\"pid\": %u, \"tid\": %u, \"args\": {\"name\": \"%s\"}}", d + 1, s,
+        StageName(s));
+  }
+
+  for (uint32_t r = 0; r < this->records.size(); r++)
+  {
+    const ProfileRecord * rec = &this->records.at(r);
+    int64_t offset = offsets.at(rec->device);
+
+    fprintf(trace, ",\n{\"name\": \"%s %u\", \"cat\": \"%s\", \"ph\": \"X\", "
+      "\"pid\": %u, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f, \"args\": "
+      "{\"chunk\": %u, \"bytes\": %llu, \"queued_us\": %.3f, "
+      "\"submit_us\": %.3f}}",
+      StageName(rec->stage), rec->chunk, StageName(rec->stage),
+      rec->device + 1, rec->stage, (rec->start + offset) / 1e3,
+      (rec->end - rec->start) / 1e3, rec->chunk,
+      static_cast<unsigned long long>(rec->bytes),
+      (rec->queued + offset) / 1e3, (rec->submit + offset) / 1e3);
+  }
+
+  for (uint32_t h = 0; h < this->spans.size(); h++)
+  {
+    const HostSpan * span = &this->spans.at(h);
+
+    fprintf(trace, ",\n{\"name\": \"%s %u\", \"cat\": \"host\", \"ph\": \"X\", "
+      "\"pid\": 0, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f, "
+      "\"args\": {\"chunk\": %u}}",
+      span->name.c_str(), span->chunk, span->device, span->start_ns / 1e3,
+      (span->end_ns - span->start_ns) / 1e3, span->chunk);
+  }
+
+  fprintf(trace, "\n]}\n");
+  fclose(trace);
+
+  printf("Trace written to %s\n", file_name.c_str());
+}
+
+//
+// Per device: for every stage the number of commands, bytes moved, time spent
+// executing and the resulting bandwidth, and the average queued -> start
+// latency. Idle is the time between the device's first command starting and
+// its last one ending during which no command at all was executing.
+//
+void Profiler::PrintSummary(std::vector<uint32_t> device_ids)
+{
+  puts("\nProfile Summary:");
+
+  for (uint32_t d = 0; d < device_ids.size(); d++)
+  {
+    uint32_t count[N_STAGES] = {0};
+    uint64_t bytes[N_STAGES] = {0};
+    uint64_t busy[N_STAGES] = {0};
+    uint64_t latency[N_STAGES] = {0};
+
+    std::vector< std::pair<cl_ulong, cl_ulong> > intervals;
+
+    for (uint32_t r = 0; r < this->records.size(); r++)
+    {
+      const ProfileRecord * rec = &this->records.at(r);
+
+      if (rec->device != d || rec->stage >= N_STAGES)
+        continue;
+
+      count[rec->stage]++;
+      bytes[rec->stage] += rec->bytes;
+      busy[rec->stage] += rec->end - rec->start;
+      latency[rec->stage] += rec->start - rec->queued;
+
+      intervals.push_back(std::make_pair(rec->start, rec->end));
+    }
+
+    if (intervals.empty())
+      continue;
+
+    // merge the intervals to find when the device was doing nothing
+
+    std::sort(intervals.begin(), intervals.end());
+
+    uint64_t idle = 0;
+    uint64_t largest_gap = 0;
+    cl_ulong covered_to = intervals.front().second;
+
+    for (uint32_t i = 1; i < intervals.size(); i++)
+    {
+      if (intervals.at(i).first > covered_to)
+      {
+        uint64_t gap = intervals.at(i).first - covered_to;
+        idle += gap;
+        largest_gap = std::max(largest_gap, gap);
+      }
+      covered_to = std::max(covered_to, intervals.at(i).second);
+    }
+
+    uint64_t span = covered_to - intervals.front().first;
+
+    printf("\tDevice %u: span %.3f (ms), idle %.3f (ms, %.1f%%), "
+      "largest gap %.3f (ms)\n", device_ids.at(d), span / 1e6, idle / 1e6,
+      span > 0 ? 100.0 * idle / span : 0.0, largest_gap / 1e6);
+
+    for (uint32_t s = 0; s < N_STAGES; s++)
+    {
+      if (count[s] == 0)
+        continue;
+
+      printf("\t\t%-7s %6u cmds, %10.3f (MB), busy %9.3f (ms), "
+        "%7.3f (GB/s), avg queued->start %.3f (ms)\n", StageName(s),
+        count[s], bytes[s] / 1e6, busy[s] / 1e6,
+        busy[s] > 0 ? static_cast<double>(bytes[s]) / busy[s] : 0.0,
+        latency[s] / 1e6 / count[s]);
+    }
+  }
+
+  puts("");
+}
+
+//EOF
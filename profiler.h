@@ -0,0 +1,125 @@
+/*
+# profiler.h
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef  OCLPTX_PROFILER_H_
+#define  OCLPTX_PROFILER_H_
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <CL/cl.hpp>
+
+//
+// Collects OpenCL event timestamps (QUEUED/SUBMIT/START/END) for every
+// command of every chunk plus host side spans, and turns them into a Chrome
+// trace-event timeline (chrome://tracing, ui.perfetto.dev) and a per device,
+// per stage summary. Requires command queues created with
+// CL_QUEUE_PROFILING_ENABLE.
+//
+
+enum ProfileStage
+{
+  STAGE_WRITE,
+  STAGE_KERNEL,
+  STAGE_READ,
+  STAGE_GENERATE,
+  N_STAGES
+};
+
+struct ProfileRecord
+{
+  uint32_t device;
+  uint32_t chunk;
+  uint32_t stage;
+  uint64_t bytes;
+  cl::Event event;
+  uint64_t host_ns; // host time just after the command was enqueued
+
+  // filled in by Collect(), device clock (ns)
+  cl_ulong queued, submit, start, end;
+};
+
+struct HostSpan
+{
+  uint32_t device;
+  uint32_t chunk;
+  std::string name;
+  uint64_t start_ns, end_ns; // host time since the profiler was created
+};
+
+class Profiler{
+
+  public:
+
+    Profiler();
+
+    ~Profiler();
+
+    void Enable(bool enable);
+
+    bool Enabled();
+
+    //
+    // Recording, safe to call from several host threads
+    //
+
+    void RecordEvent(uint32_t device, uint32_t chunk, uint32_t stage,
+      uint64_t bytes, const cl::Event & event);
+
+    void RecordSpan(uint32_t device, uint32_t chunk, std::string name,
+      std::chrono::high_resolution_clock::time_point start,
+      std::chrono::high_resolution_clock::time_point end);
+
+    //
+    // Reporting, once every recorded command has completed
+    //
+
+    // Queries the profiling info of all recorded events.
+    cl_int Collect();
+
+    void WriteTrace(std::string file_name, std::vector<uint32_t> device_ids);
+
+    void PrintSummary(std::vector<uint32_t> device_ids);
+
+    static const char * StageName(uint32_t stage);
+
+  private:
+
+    uint64_t HostNs(std::chrono::high_resolution_clock::time_point t);
+
+    // device clock to host clock offset (ns), per device
+    std::vector<int64_t> ClockOffsets(uint32_t n_devices);
+
+    bool enabled;
+
+    std::chrono::high_resolution_clock::time_point origin;
+
+    std::mutex record_mutex;
+
+    std::vector<ProfileRecord> records;
+
+    std::vector<HostSpan> spans;
+};
+
+#endif
+
+//EOF
@@ -0,0 +1,302 @@
+/*
+# scheduler.cc
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <cstdio>
+#include <vector>
+
+#include "scheduler.h"
+
+typedef std::chrono::high_resolution_clock sched_clock;
+
+//*********************************************************************
+//
+// ChunkScheduler Constructors/Destructors
+//
+//*********************************************************************
+//
+// Constructor(s)
+//
+ChunkScheduler::ChunkScheduler(uint32_t n_chunks, uint32_t n_devices,
+  uint32_t retries, uint32_t quarantine) : total_chunks(n_chunks),
+  next_chunk(0), retries(retries), quarantine(quarantine), finished(0),
+  aborted(false), n_retries(0), attempts(n_chunks, 0), healthy(n_devices)
+{
+  DeviceStats empty = {0, 0, sched_clock::time_point(),
+    sched_clock::time_point()};
+
+  for (uint32_t d = 0; d < n_devices; d++)
+  {
+    this->mailboxes.push_back(new Mailbox());
+    this->mailboxes.back()->stats = empty;
+    this->mailboxes.back()->failures = 0;
+    this->mailboxes.back()->quarantined = false;
+  }
+
+  // nothing could ever complete
+  this->aborted = (n_devices == 0 && n_chunks > 0);
+}
+
+//
+// Destructor
+//
+ChunkScheduler::~ChunkScheduler()
+{
+  for (uint32_t d = 0; d < this->mailboxes.size(); d++)
+    delete this->mailboxes.at(d);
+}
+
+//*********************************************************************
+//
+// ChunkScheduler Chunk Queue
+//
+//*********************************************************************
+
+bool ChunkScheduler::Next(uint32_t device, uint32_t * chunk)
+{
+  if (this->mailboxes.at(device)->quarantined || this->aborted)
+    return false;
+
+  bool claimed_retry = false;
+
+  if (this->n_retries > 0)
+  {
+    std::lock_guard<std::mutex> lock(this->retry_mutex);
+
+    // leave a chunk to the other devices when device is the one that just
+    // failed it, unless no other device is left
+    for (std::deque<Retry>::iterator r = this->retry_queue.begin();
+      r != this->retry_queue.end(); r++)
+    {
+      if (r->failed_on == device && this->healthy > 1)
+        continue;
+
+      *chunk = r->chunk;
+      this->retry_queue.erase(r);
+      this->n_retries--;
+      claimed_retry = true;
+      break;
+    }
+  }
+
+  if (!claimed_retry)
+  {
+    // the counter may overshoot total_chunks once the queue is drained,
+    // which is harmless as long as nobody claims those indices
+    uint32_t claimed = this->next_chunk.fetch_add(1);
+
+    if (claimed >= this->total_chunks)
+      return false;
+
+    *chunk = claimed;
+  }
+
+  DeviceStats * ds = &this->mailboxes.at(device)->stats;
+  if (ds->first_start == sched_clock::time_point())
+    ds->first_start = sched_clock::now();
+
+  return true;
+}
+
+uint32_t ChunkScheduler::HowManyChunks()
+{
+  return this->total_chunks;
+}
+
+//*********************************************************************
+//
+// ChunkScheduler Failover
+//
+//*********************************************************************
+
+void ChunkScheduler::Completed(uint32_t device, uint32_t chunk)
+{
+  {
+    std::lock_guard<std::mutex> lock(this->retry_mutex);
+    this->mailboxes.at(device)->failures = 0;
+  }
+
+  // the last chunk ends the run for everyone waiting for retries
+  if (this->finished.fetch_add(1) + 1 == this->total_chunks)
+    this->WakeAll();
+}
+
+bool ChunkScheduler::Failed(uint32_t device, uint32_t chunk)
+{
+  Mailbox * box = this->mailboxes.at(device);
+  bool abort = false;
+  bool quarantined;
+
+  {
+    std::lock_guard<std::mutex> lock(this->retry_mutex);
+
+    box->failures++;
+    if (!box->quarantined && box->failures >= this->quarantine)
+    {
+      box->quarantined = true;
+      this->healthy--;
+    }
+    quarantined = box->quarantined;
+
+    if (++this->attempts.at(chunk) > this->retries || this->healthy == 0)
+    {
+      abort = true;
+    }
+    else
+    {
+      Retry retry = {chunk, device};
+      this->retry_queue.push_back(retry);
+      this->n_retries++;
+    }
+  }
+
+  if (abort)
+    this->aborted = true;
+
+  this->WakeAll();
+
+  return quarantined;
+}
+
+void ChunkScheduler::Quarantine(uint32_t device)
+{
+  std::lock_guard<std::mutex> lock(this->retry_mutex);
+
+  if (this->mailboxes.at(device)->quarantined)
+    return;
+
+  this->mailboxes.at(device)->quarantined = true;
+  if (--this->healthy == 0 && this->total_chunks > 0)
+    this->aborted = true;
+}
+
+bool ChunkScheduler::Quarantined(uint32_t device)
+{
+  std::lock_guard<std::mutex> lock(this->retry_mutex);
+  return this->mailboxes.at(device)->quarantined;
+}
+
+bool ChunkScheduler::Finished()
+{
+  return this->aborted || this->finished == this->total_chunks;
+}
+
+bool ChunkScheduler::Aborted()
+{
+  return this->aborted;
+}
+
+void ChunkScheduler::WakeAll()
+{
+  for (uint32_t d = 0; d < this->mailboxes.size(); d++)
+  {
+    Mailbox * box = this->mailboxes.at(d);
+    SlotCompletion wake = {d, NO_SLOT, 0};
+
+    {
+      std::lock_guard<std::mutex> lock(box->mutex);
+      box->completed.push_back(wake);
+    }
+
+    box->cv.notify_one();
+  }
+}
+
+//*********************************************************************
+//
+// ChunkScheduler Completion Reporting
+//
+//*********************************************************************
+
+void ChunkScheduler::Done(uint32_t device, uint32_t slot, uint64_t bytes,
+  int32_t status)
+{
+  SlotCompletion sc = {device, slot, status};
+  Mailbox * box = this->mailboxes.at(device);
+
+  {
+    std::lock_guard<std::mutex> lock(box->mutex);
+
+    box->completed.push_back(sc);
+
+    if (status >= 0)
+    {
+      box->stats.chunks++;
+      box->stats.bytes += bytes;
+      box->stats.last_done = sched_clock::now();
+    }
+  }
+
+  box->cv.notify_one();
+}
+
+void ChunkScheduler::Processed(uint32_t device, uint64_t bytes)
+{
+  Mailbox * box = this->mailboxes.at(device);
+  std::lock_guard<std::mutex> lock(box->mutex);
+
+  box->stats.chunks++;
+  box->stats.bytes += bytes;
+  box->stats.last_done = sched_clock::now();
+}
+
+void ChunkScheduler::WaitDone(uint32_t device,
+  std::vector<SlotCompletion> * done)
+{
+  Mailbox * box = this->mailboxes.at(device);
+  std::unique_lock<std::mutex> lock(box->mutex);
+
+  box->cv.wait(lock, [box]{ return !box->completed.empty(); });
+
+  done->clear();
+  done->swap(box->completed);
+}
+
+//*********************************************************************
+//
+// ChunkScheduler Throughput Tracking
+//
+//*********************************************************************
+
+DeviceStats ChunkScheduler::GetStats(uint32_t device)
+{
+  Mailbox * box = this->mailboxes.at(device);
+  std::lock_guard<std::mutex> lock(box->mutex);
+  return box->stats;
+}
+
+void ChunkScheduler::PrintStats(std::vector<std::string> device_names)
+{
+  puts("\nPer Device Throughput:");
+
+  for (uint32_t d = 0; d < device_names.size(); d++)
+  {
+    DeviceStats ds = this->GetStats(d);
+
+    double busy = std::chrono::duration<double>(
+      ds.last_done - ds.first_start).count();
+
+    printf("\t%s: %d chunks, %.3f (MB), %.3f (GB/s)\n",
+      device_names.at(d).c_str(), ds.chunks, ds.bytes / 1e6,
+      (ds.chunks > 0 && busy > 0) ? ds.bytes / busy / 1e9 : 0.0);
+  }
+  puts("");
+}
+
+//EOF
@@ -0,0 +1,182 @@
+/*
+# scheduler.h
+#     for learnOpenCL
+#     Copyright (C) 2015 Steve Novakov
+
+#     This program is free software; you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation; either version 2 of the License, or
+#     (at your option) any later version.
+
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+
+#     You should have received a copy of the GNU General Public License along
+#     with this program; if not, write to the Free Software Foundation, Inc.,
+#     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef  OCLPTX_SCHEDULER_H_
+#define  OCLPTX_SCHEDULER_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//
+// Shared chunk queue. Devices claim the next unprocessed chunk whenever one
+// of their pipeline slots drains, so faster devices end up processing more
+// chunks instead of every device getting an equal static slice.
+//
+// Each device is driven by its own submission thread. Claiming a chunk is a
+// single atomic increment, and completions, reported from OpenCL event
+// callbacks (driver threads), go to the mailbox of the device they belong to,
+// so submission threads never wait on each other.
+//
+// A chunk that fails goes back into the queue, ahead of the unclaimed ones,
+// for another device to retry. A device whose chunks keep failing is
+// quarantined: it claims nothing more, and whatever it still has in flight
+// is retried elsewhere as it fails. The run is over once every chunk has
+// completed, or failed too often, or no device is left, so a device only
+// stops waiting for work when the run is.
+//
+
+// SlotCompletion::slot of a wake-up: a retry was queued or the run is over
+const uint32_t NO_SLOT = 0xFFFFFFFF;
+
+struct SlotCompletion
+{
+  uint32_t device;
+  uint32_t slot;
+  int32_t status; // CL_COMPLETE, or a negative OpenCL error code
+};
+
+struct DeviceStats
+{
+  uint32_t chunks;
+  uint64_t bytes;
+  std::chrono::high_resolution_clock::time_point first_start;
+  std::chrono::high_resolution_clock::time_point last_done;
+};
+
+class ChunkScheduler{
+
+  public:
+
+    // retries: times a chunk is retried before the run fails; quarantine:
+    // failures in a row that take a device out
+    ChunkScheduler(uint32_t n_chunks, uint32_t n_devices, uint32_t retries,
+      uint32_t quarantine);
+
+    ~ChunkScheduler();
+
+    //
+    // Chunk Queue
+    //
+
+    // Claims the next chunk for device, a retry if there is one, else lock
+    // free. Returns false while there is nothing to claim, and always for a
+    // quarantined device. Only ever called from device's own thread.
+    bool Next(uint32_t device, uint32_t * chunk);
+
+    uint32_t HowManyChunks();
+
+    //
+    // Failover, only ever called from device's own thread
+    //
+
+    // chunk is done for good, device's failures in a row start over
+    void Completed(uint32_t device, uint32_t chunk);
+
+    // Queues chunk for a retry, or fails the run if it has had all of them.
+    // Returns true if device is quarantined (now or before).
+    bool Failed(uint32_t device, uint32_t chunk);
+
+    // takes device out before the run starts, e.g. quarantined in an
+    // earlier one
+    void Quarantine(uint32_t device);
+
+    bool Quarantined(uint32_t device);
+
+    // every chunk completed, or the run failed
+    bool Finished();
+
+    // a chunk failed more than retries times or every device is quarantined
+    bool Aborted();
+
+    //
+    // Completion Reporting
+    //
+
+    // Safe to call from any thread, including OpenCL callbacks.
+    void Done(uint32_t device, uint32_t slot, uint64_t bytes, int32_t status);
+
+    // For engines without pipeline slots (the host backend): only updates the
+    // throughput statistics.
+    void Processed(uint32_t device, uint64_t bytes);
+
+    // Blocks until at least one of device's slots has completed, or a
+    // wake-up (NO_SLOT) arrived, then hands over (and clears) everything
+    // device received so far.
+    void WaitDone(uint32_t device, std::vector<SlotCompletion> * done);
+
+    //
+    // Throughput Tracking, once every device thread has finished
+    //
+
+    DeviceStats GetStats(uint32_t device);
+
+    void PrintStats(std::vector<std::string> device_names);
+
+  private:
+
+    // a NO_SLOT completion for every device
+    void WakeAll();
+
+    uint32_t total_chunks;
+
+    std::atomic<uint32_t> next_chunk;
+
+    uint32_t retries;
+    uint32_t quarantine;
+
+    std::atomic<uint32_t> finished; // chunks completed
+    std::atomic<bool> aborted;
+
+    // failed chunks waiting for a retry, and the failure counts, guarded by
+    // retry_mutex
+    std::mutex retry_mutex;
+    struct Retry
+    {
+      uint32_t chunk;
+      uint32_t failed_on; // device of the last attempt
+    };
+    std::deque<Retry> retry_queue;
+    std::atomic<uint32_t> n_retries; // retry_queue.size(), read lock free
+    std::vector<uint32_t> attempts; // failures per chunk
+    uint32_t healthy; // devices not quarantined
+
+    struct Mailbox
+    {
+      std::mutex mutex;
+      std::condition_variable cv;
+      std::vector<SlotCompletion> completed;
+      DeviceStats stats; // first_start is only touched by Next()
+
+      uint32_t failures; // in a row
+      bool quarantined;
+    };
+
+    std::vector<Mailbox*> mailboxes; // one per device
+};
+
+#endif
+
+//EOF